@@ -1,57 +1,150 @@
 #include <Arduino.h>
 #include "OpenAirMultiSense.h"
+#include "sensorDrivers.h"
+#include "eventLoop.h"
+#include "recordRing.h"
+#include "powerManager.h"
+#include "plumeCapture.h"
 
 #define DEBUG_OUT_ENABLED
 
 #ifndef DEBUG_OUT_ENABLED
 #define FLASH_MEM
+#define ARCHIVE_SESSIONS
+#define DUTY_PERIOD     300000  // [ms] sensor duty cycle for unattended sessions, see dutyCycle.h
+#define DUTY_BURST      60000   // [ms] sampled at the start of every period
+#define PMS_PASSIVE     true    // Active-mode Plantower sensors keep the chip out of light sleep
+#endif
+
+#ifndef PMS_PASSIVE
+#define PMS_PASSIVE     false
+#endif
+
+#ifndef DUTY_PERIOD
+#define DUTY_PERIOD     0       // Sensors always on
+#define DUTY_BURST      0
 #endif
 
 #define PLANTOWER_PMS5003
+// #define SHARED_UART         // SPS30 and PMS5003 take turns on Serial0, see uartPorts.h
 
-#define PMS5003_SERIAL_PORT Serial0
-#define PMS7003_SERIAL_PORT Serial1
-#define CUBIC_SERIAL_PORT  Serial1
-#define SPS30_SERIAL_PORT Serial0
 #define DEBUG_OUT Serial
 #define DEBUG_OUT_BAUD 115200
-#define NO_ERROR 0
 #define READ_INTERVAL   1000    // [ms]
 #define BOOT_TIME       10000   // [ms]
 #define TOTAL_SCREEN    3
+#define ARCHIVE_STEP_BYTES  1024    // Compressed per step so sampling isn't delayed
+#define ARCHIVE_INTERVAL    100     // [ms] between archive steps
+#define ARCHIVE_IDLE_INTERVAL 10000 // [ms] between looks for a closed session
+#define WATCHDOG_INTERVAL   1000    // [ms]
+#define WATCHDOG_PULSE      1       // [ms] DONE pulse width
+#define SERIAL_POLL_INTERVAL 20     // [ms]
+#define SERIAL_IDLE_POLL_INTERVAL 1000  // [ms] without a USB host, so the light sleeps aren't cut short
+#define SPACE_CHECK_INTERVAL 100    // [ms] between deletions of old sessions
+#define BUTTON_DEBOUNCE     30      // [ms] edges closer than this are bounce
+#define SHORT_PRESS_TIME    1000    // [ms] shorter presses change the screen
+#define LONG_PRESS_TIME     5000    // [ms] held this long toggles logging
+#define LED_BLINK_TIME      100     // [ms]
+#define POWER_LOG_INTERVAL  60000   // [ms] between EVENT_POWER records
+#define CAPTURE_ENABLED     false   // Plume capture instead of logging every record, see plumeCapture.h
+
+// Tasks: acquisition runs above the consumers, loop() (UI, serial) at priority 1
+#define ACQUISITION_PRIORITY    3
+#define LOGGER_PRIORITY         2
+#define TASK_STACK_SIZE         4096    // [bytes]
+#define ACQUISITION_STALL_TIME  30000   // [ms] without an acquisition cycle before the watchdog isn't kicked
+#define LOGGER_RING_SIZE        32      // Records buffered for the flash logger
+#define EVENT_RING_SIZE         8
+#define UI_RING_SIZE            4       // The UI only shows the newest record
+
+// Events posted to eventLoop by interrupts and tasks
+enum loopEvents {
+    LOOP_BUTTON_DOWN = 0,
+    LOOP_BUTTON_UP,
+    LOOP_RECORD                         // A record is waiting in uiRing
+};
+
+// A record with its acquisition timing, for the UI consumer
+struct Sample {
+    SensorPayload payload;
+    uint32_t time_taken[4];             // [us] per sensor slot
+    uint32_t cycleTime;                 // [ms] whole acquisition
+    uint32_t powerTime[POWER_STATE_COUNT];  // [ms] in each power state since the previous record
+    uint32_t charge;                    // [nAh] estimated since the previous record
+};
 
 Adafruit_SH1106G display = Adafruit_SH1106G(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
-SensirionUartSps30 sps30_sensor;
-Adafruit_PM25AQI pmsa_sensor = Adafruit_PM25AQI();
-PM2008_I2C pm2016_i2c;
-Cubic_PMsensor_UART pm2012_uart(CUBIC_SERIAL_PORT);
-SensorPayload sensorPayload;
-
-PMS pms5003(PMS5003_SERIAL_PORT);
-PMS::DATA pms5003_buffer;
-
-PMS pms7003(PMS7003_SERIAL_PORT);
-PMS::DATA pms7003_buffer;
-
-static char errorMessage[64];
-static int16_t error;
-unsigned long buttonPressTime = 0;
-bool isPressing = false;
-bool longPressTriggered = false;
+SensorPayload sensorPayload;           // Record being acquired, owned by the acquisition task
+SensorPayload latestPayload;           // Newest record for the display
+
+// Sensors read by this build, see sensorDrivers.h. UART sensors get their
+// port and pins from uartPorts; sensors on one port are read in turn, so
+// list them next to each other to save port switches.
+#if defined(SHARED_UART)
+typedef SensorSet<Sps30Driver<>,
+                  PmsDriver<UART_PMS5003, PMS_PASSIVE>,
+                  Pm2012Driver,
+                  Pm2016Driver<>> ActiveSensors;
+#elif defined(PLANTOWER_PMS5003)
+typedef SensorSet<PmsDriver<UART_PMS5003, PMS_PASSIVE>,
+                  PmsDriver<UART_PMS7003, PMS_PASSIVE>,
+                  Pm2016Driver<>> ActiveSensors;
+#else
+typedef SensorSet<Pmsa003iDriver,
+                  Pm2012Driver,
+                  Pm2016Driver<>,
+                  Sps30Driver<>> ActiveSensors;
+#endif
+ActiveSensors activeSensors;
+DutyCycle dutyCycle;
+
+// Acquisition publishes every record to one ring per consumer: the flash
+// logger task, and the UI (display, debug, USB stream) in loop()
+RecordRing<SensorPayload, LOGGER_RING_SIZE> loggerRing;
+RecordRing<EventRecord, EVENT_RING_SIZE> eventRing;
+RecordRing<Sample, UI_RING_SIZE> uiRing;
+TaskHandle_t acquisitionTask = NULL;
+TaskHandle_t loggerTask = NULL;
+SemaphoreHandle_t sensorLock;           // activeSensors, uartPorts, dutyCycle
+SemaphoreHandle_t logLock;              // loggingActive, log_name
+volatile uint32_t lastCycleTime = 0;    // millis() of the last completed acquisition cycle
+volatile uint32_t nextSampleTime = 0;   // millis() the next acquisition is due
+
 bool loggingActive = false;
-uint32_t loop_delay = 0;
+bool streamActive = false;
 uint32_t button_cnt = 0;
 String log_name = "./sensor_logs";
 const size_t MIN_FREE_SPACE = 600000; // 200KB
 
-// 'volatile' is required for variables used inside interrupts
-volatile unsigned long pressStartTime = 0;
-volatile unsigned long button_duration = 0;
-volatile bool buttonReleased = false;
-volatile bool buttonPressed = false;
+// Button state, updated from the events of handleButtonInterrupt()
+uint32_t pressStartTime = 0;
+uint32_t lastButtonEdge = 0;
+bool buttonDown = false;
+int8_t longPressTimer = TIMER_NONE;
+int8_t debounceTimer = TIMER_NONE;
+int8_t ledTimer = TIMER_NONE;
+int8_t serialTimer = TIMER_NONE;
+uint8_t ledToggles = 0;
 
 void readStoredLogs();
+void printLogEntry(const SensorPayload& entry);
+void printEventEntry(const EventRecord& event);
+bool isEventRecord(const SensorPayload& entry);
+void queryStoredLogs(String fileName, bool byTime, uint32_t from, uint32_t to);
+void handleSerialCommand();
+void pollSerial();
+void listSessions();
+void sendSession(String fileName, uint32_t offset, bool compress);
+void sendBlockMap();
+bool archiveClosedSessions();
+void archiveStep();
+String indexFileName(String log_name);
+String archiveFileName(String log_name);
+bool isIndexFile(String fileName);
+bool isArchiveFile(String fileName);
 void startLogRawStream(String new_log, const SensorPayload& payload);
+void logEventRecord(String new_log, const EventRecord& event);
+void streamRawPayload(const SensorPayload& payload);
 void stopLogRawStream();
 void startLogging(bool enable);
 void changeScreen(uint32_t* currentScreen);
@@ -59,7 +152,23 @@ void systemDisplay(uint8_t currentScreen);
 void displayLoggingStatus();
 void displayPmValue();
 void displayFilesSystem();
-void handleButton();
+void acquisitionTaskMain(void* arg);
+void loggerTaskMain(void* arg);
+void sampleSensors();
+void measurePower(Sample& sample);
+void onRecord(uint32_t data, uint32_t time);
+void printSample(const Sample& sample);
+void printTasks();
+void printDuty();
+void kickWatchdog();
+void releaseWatchdog();
+void onButtonDown(uint32_t data, uint32_t time);
+void onButtonUp(uint32_t data, uint32_t time);
+void onLongPress();
+void debounceButton();
+void resampleButton();
+void blinkLed(uint8_t count);
+void ledStep();
 int getFileList();
 void ensureSpace();
 String startNewLogFile(String log_name);
@@ -67,17 +176,10 @@ void deleteSpecificFile(const char* filename) ;
 void deleteAllFiles();
 
 
-// Interrupt Service Routine (ISR) - must be in RAM for speed
+// Interrupt Service Routine (ISR) - must be in RAM for speed. Only queues
+// the edge, onButtonDown() / onButtonUp() handle it in loop context.
 void IRAM_ATTR handleButtonInterrupt() {
-    int currentState = digitalRead(BUTTON_PIN);
-    
-    if (currentState == LOW) { // Button Pressed
-        pressStartTime = millis();
-        buttonPressed = true;
-    } else { // Button Released
-        button_duration = millis() - pressStartTime;
-        buttonReleased = true;
-    }
+    eventLoop.post(digitalRead(BUTTON_PIN) == LOW ? LOOP_BUTTON_DOWN : LOOP_BUTTON_UP);
 }
 
 void setup() {
@@ -91,11 +193,7 @@ void setup() {
 
     pinMode(BUTTON_PIN,INPUT);
     pinMode(WATCHDOG_DONE_PIN,OUTPUT);
-    pinMode(PMSA003I_SET_PIN, OUTPUT);
-    pinMode(PMSA003I_RESET_PIN, OUTPUT);
     pinMode(LED_PIN,OUTPUT);
-    digitalWrite(PMSA003I_SET_PIN, HIGH);   // Set to HIGH to enable I2C mode
-    digitalWrite(PMSA003I_RESET_PIN, HIGH); // Keep the sensor out of reset
     digitalWrite(WATCHDOG_DONE_PIN,LOW);
     digitalWrite(LED_PIN,LOW);
     delay(100);
@@ -121,62 +219,11 @@ void setup() {
     display.display(); // You MUST call this to actually show data
 
     // Trigger on CHANGE (both press and release)
+    eventLoop.on(LOOP_BUTTON_DOWN, onButtonDown);
+    eventLoop.on(LOOP_BUTTON_UP, onButtonUp);
     attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), handleButtonInterrupt, CHANGE);
 
-    SPS30_SERIAL_PORT.begin(DEBUG_OUT_BAUD);
-    if(SPS30_SERIAL_PORT){
-        DEBUG_OUT.println("Serial0 initialized successfully.");
-    } else {
-        DEBUG_OUT.println("Serial0 initialization failed!");
-    }
-    
-    #ifndef PLANTOWER_PMS5003
-    int8_t serialNumber[32] = {0};
-    int8_t productType[9] = {0};
-    sps30_sensor.begin(SPS30_SERIAL_PORT);
-    sps30_sensor.stopMeasurement();
-    error |= sps30_sensor.readSerialNumber(serialNumber, 32); delay(100);
-    error |= sps30_sensor.readProductType(productType, 9); delay(100);
-    error |= sps30_sensor.startMeasurement(SPS30_OUTPUT_FORMAT_OUTPUT_FORMAT_UINT16); delay(100);
-    if (error != NO_ERROR) {
-        DEBUG_OUT.print("Error trying to execute sps30 sensor: ");
-        errorToString(error, errorMessage, sizeof errorMessage);
-        DEBUG_OUT.println(errorMessage);
-    }else{
-        DEBUG_OUT.print("SPS30 serialNumber: ");
-        DEBUG_OUT.print((const char*)serialNumber);
-        DEBUG_OUT.println();
-        DEBUG_OUT.print("SPS30 productType: ");
-        DEBUG_OUT.print((const char*)productType);
-        DEBUG_OUT.println();
-    }
-
-    if (!pmsa_sensor.begin_I2C()) {      // connect to the sensor over I2C
-        DEBUG_OUT.println("Could not find PM 2.5 sensor!");
-    }else{
-        DEBUG_OUT.println("PMSA003I found!");
-    }
-    pm2016_i2c.command();
-
-    CUBIC_SERIAL_PORT.begin(9600, SERIAL_8N1, UART2_RX, UART2_TX);
-    startWait = millis();
-    while (!CUBIC_SERIAL_PORT && (millis() - startWait < 5000)) {
-        delay(100); 
-    }
-    Serial.println("Cubic PM UART sensor initialize.");
-
-    #else
-    PMS5003_SERIAL_PORT.begin(9600);    // Plantower Serial Port
-    pms5003.activeMode();               // Switch to active mode
-    pms5003.wakeUp();                   // Waking up, wait for stable readings
-    delay(100);                         // Delay wake up time
-
-    PMS7003_SERIAL_PORT.begin(9600,     // Plantower Serial Port
-                        SERIAL_8N1, 
-                        UART2_RX, UART2_TX);    
-    pms7003.activeMode();               // Switch to active mode
-    pms7003.wakeUp();                   // Waking up, wait for stable readings
-    #endif
+    activeSensors.begin();
 
     if (!LittleFS.begin(true)) {
         Serial.println("LittleFS Mount Failed");
@@ -188,159 +235,260 @@ void setup() {
     #endif
 
     // DEBUG_OUT.println("Initialization complete. Wait for 30 seconds for sensors to stabilize...");
-    delay(BOOT_TIME); // Wait for sensors to stabilize
+    powerManager.begin(BUTTON_PIN);
+    dutyCycle.period = DUTY_PERIOD;
+    dutyCycle.burst = DUTY_BURST;
+    plumeCapture.enabled = CAPTURE_ENABLED;
+    sensorLock = xSemaphoreCreateMutex();
+    logLock = xSemaphoreCreateMutex();
+    eventLoop.on(LOOP_RECORD, onRecord);
+    xTaskCreate(loggerTaskMain, "logger", TASK_STACK_SIZE, NULL, LOGGER_PRIORITY, &loggerTask);
+    xTaskCreate(acquisitionTaskMain, "acquisition", TASK_STACK_SIZE, NULL, ACQUISITION_PRIORITY, &acquisitionTask);
+
+    eventLoop.every(WATCHDOG_INTERVAL, kickWatchdog);
+    serialTimer = eventLoop.every(SERIAL_POLL_INTERVAL, pollSerial);
+    #ifdef ARCHIVE_SESSIONS
+    eventLoop.after(ARCHIVE_INTERVAL, archiveStep);
+    #endif
     // DEBUG_OUT.println("Starting measurements now.");
 }
 
 void loop() {
-    
-    delay(READ_INTERVAL - loop_delay); // 1 second delay between readings
+    eventLoop.run();
+
+    // Nothing to do until the next timer or sample: light sleep, unless a
+    // USB host is connected (the USB port stops in sleep) or the button is held
+    int32_t untilSample = nextSampleTime - millis();
+    uint32_t idle = min(eventLoop.idleTime(), (uint32_t)max(untilSample, (int32_t)0));
+    if (powerManager.idle(idle, !DEBUG_OUT && !buttonDown)) {
+        // The RTOS tick stood still, wake the acquisition task to re-check its deadline
+        xTaskNotifyGive(acquisitionTask);
+        // The button's edge happened in sleep
+        if (powerManager.lastWake() == WAKE_GPIO && digitalRead(BUTTON_PIN) == LOW) {
+            eventLoop.post(LOOP_BUTTON_DOWN);
+        }
+    }
+}
+
+/**
+ * Acquisition task: one record every READ_INTERVAL, independent of how long
+ * the consumers take to store or show it. The schedule is kept in millis(),
+ * which light sleep doesn't disturb; loop() notifies the task after a sleep.
+ * With a duty cycle, records are only taken in the bursts; in between the
+ * task only wakes to switch sensors and, for the watchdog, at least every
+ * half ACQUISITION_STALL_TIME.
+ */
+void acquisitionTaskMain(void* arg) {
+    lastCycleTime = millis();
+    nextSampleTime = millis() + BOOT_TIME;  // Wait for sensors to stabilize
+    dutyCycle.epoch = nextSampleTime;
+    for (;;) {
+        int32_t wait;
+        while ((wait = nextSampleTime - millis()) > 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+        }
+
+        // Switches follow the schedule, not how late the task woke up
+        uint32_t now = nextSampleTime;
+        xSemaphoreTake(sensorLock, portMAX_DELAY);
+        activeSensors.updatePower(now, dutyCycle);
+        bool sampling = dutyCycle.sampling(now);
+        uint32_t idle = min(dutyCycle.untilBurst(now), activeSensors.untilSwitch(now, dutyCycle));
+        xSemaphoreGive(sensorLock);
+
+        if (sampling) {
+            powerManager.sampleStarted(millis() - now);
+            sampleSensors();
+        }
+        lastCycleTime = millis();
+
+        uint32_t next = now + (sampling ? READ_INTERVAL : constrain(idle, (uint32_t)READ_INTERVAL, (uint32_t)ACQUISITION_STALL_TIME / 2));
+        int32_t late = millis() - next;
+        if (late >= 0) {
+            next += (late / READ_INTERVAL + 1) * READ_INTERVAL;    // Overran, skip the missed samples
+        }
+        nextSampleTime = next;
+    }
+}
+
+/**
+ * One acquisition, published to the consumers' rings. The sensor I/O is the
+ * only part of the firmware that waits.
+ */
+void sampleSensors() {
+    Sample sample = {};
+    powerManager.enter(POWER_ACTIVE);
     sensorPayload.counter++;
     sensorPayload.timestamp = millis();
-#ifdef DEBUG_OUT_ENABLED
-    DEBUG_OUT.printf("Reading - #%d \n", sensorPayload.counter);
-    DEBUG_OUT.printf("Timestamp: %d ms\n", sensorPayload.timestamp);
-#endif
 
-    //Reset Watchdog
-    digitalWrite(WATCHDOG_DONE_PIN,HIGH);
-    delay(1);
-    digitalWrite(WATCHDOG_DONE_PIN,LOW);
+    xSemaphoreTake(sensorLock, portMAX_DELAY);
+    activeSensors.read(sensorPayload, sample.time_taken);   //[SPS30,003i,PM2012,PM2016]
+    xSemaphoreGive(sensorLock);
 
-    uint32_t time_taken[4];     //[SPS30,003i,PM2012,PM2016]
-    uint32_t tStart_measure;    // Timestamp before start measurement each sensors;
-
-#ifndef PLANTOWER_PMS5003
-    // Reading PMSA003i Measurement
-    tStart_measure = micros();
-    PM25_AQI_Data data;
-    if (!pmsa_sensor.read(&data)) {
-        DEBUG_OUT.println("Could not read from PMSA003");
-        sensorPayload.pmsa003iData.particles = -1;
-        sensorPayload.pmsa003iData.concentration = -1;
-    }else{
-        sensorPayload.pmsa003iData.particles = data.particles_03um;
-        sensorPayload.pmsa003iData.concentration = data.pm25_env;
-    }
-    time_taken[PMSA003I] = micros() - tStart_measure;
-#else
-    // Reading PMS5003 Measurement
-    tStart_measure = micros();
-    if (pms5003.readUntil(pms5003_buffer)) {
-        sensorPayload.pmsa003iData.particles = pms5003_buffer.PM_PC_0_3;
-        sensorPayload.pmsa003iData.concentration = pms5003_buffer.PM_AE_UG_2_5;
-    }else{
-        DEBUG_OUT.println("Could not read from PMS-5003");
-        sensorPayload.pmsa003iData.particles = -1;
-        sensorPayload.pmsa003iData.concentration = -1;
-    }
-    time_taken[PMSA003I] = micros() - tStart_measure;
+    sample.payload = sensorPayload;
+    sample.cycleTime = millis() - sensorPayload.timestamp;
+    powerManager.enter(POWER_IDLE);
+    measurePower(sample);
 
-    // Reading PMS7003 Measurement
-    tStart_measure = micros();
-    if (pms7003.readUntil(pms7003_buffer)) {
-        sensorPayload.pmsa003iData.particles = pms7003_buffer.PM_PC_0_3;
-        sensorPayload.pmsa003iData.concentration = pms7003_buffer.PM_AE_UG_2_5;
-    }else{
-        DEBUG_OUT.println("Could not read from PMS-7003");
-        sensorPayload.pmsa003iData.particles = -1;
-        sensorPayload.pmsa003iData.concentration = -1;
+    loggerRing.push(sensorPayload);
+    xTaskNotifyGive(loggerTask);
+    if (uiRing.push(sample)) {
+        eventLoop.post(LOOP_RECORD);
     }
-    time_taken[PMSA003I] = micros() - tStart_measure;
-#endif
+}
 
-    // Reading PM2012 Measurement
-    tStart_measure = micros();
-    PMData s3_data;
-    bool s3_ret = pm2012_uart.readMeasurement(s3_data);
-    if(s3_ret == true) {
-        sensorPayload.cubicPm2012.particles = s3_data.count_0_3;
-        sensorPayload.cubicPm2012.concentration = s3_data.pm2_5_grimm;
-        sensorPayload.cubicPm2012Tsi = s3_data.pm2_5_tsi;
-    }else{
-        Serial.println("Could not read from PM2012");
-        sensorPayload.cubicPm2012.particles = -1;
-        sensorPayload.cubicPm2012.concentration = -1;
-        sensorPayload.cubicPm2012Tsi = -1;
+/**
+ * Time in each power state and estimated charge since the previous record.
+ * Every POWER_LOG_INTERVAL the totals since boot are logged as an
+ * EVENT_POWER, so the battery life can be worked out from the session.
+ */
+void measurePower(Sample& sample) {
+    static uint64_t lastTime[POWER_STATE_COUNT] = {};
+    static uint64_t lastCharge = 0;
+    static uint32_t lastEvent = 0;
+
+    for (uint8_t s = 0; s < POWER_STATE_COUNT; s++) {
+        uint64_t t = powerManager.stateTime(s);
+        sample.powerTime[s] = (t - lastTime[s]) / 1000;
+        lastTime[s] = t;
     }
-    time_taken[PM2012] = micros() - tStart_measure;
-
-
-    // Reading PM2016 Measurement
-    tStart_measure = micros();
-    uint8_t ret = pm2016_i2c.read();
-    if (ret == 0) {
-        sensorPayload.cubicPm2016.particles = pm2016_i2c.number_of_0p3_um;
-        sensorPayload.cubicPm2016.concentration = pm2016_i2c.pm2p5_grimm;
+    uint64_t charge = powerManager.charge();
+    sample.charge = charge - lastCharge;
+    lastCharge = charge;
+
+    if (millis() - lastEvent < POWER_LOG_INTERVAL) return;
+    lastEvent = millis();
+    EventRecord event;
+    event.counter = sensorPayload.counter;
+    event.timestamp = lastEvent;
+    event.type = EVENT_POWER;
+    event.source = min(powerManager.takeMaxLateness(), (uint32_t)255);
+    event.data[0] = lastTime[POWER_ACTIVE] / 1000;
+    event.data[1] = lastTime[POWER_IDLE] / 1000;
+    event.data[2] = lastTime[POWER_SLEEP] / 1000;
+    event.data[3] = charge / 1000;
+    eventRing.push(event);
+}
 
-    }else{
-        Serial.println("Could not read from PM2016");
-        sensorPayload.cubicPm2016.particles = -1;
-        sensorPayload.cubicPm2016.concentration = -1;
-    }
-    time_taken[PM2016] = micros() - tStart_measure;
-
-
-    // Reading SPS30 Measurement
-    tStart_measure = micros();
-    SensirionMeasurement sps30_measurement;
-    error = sps30_sensor.readMeasurementValuesUint16(sps30_measurement.mc1p0, sps30_measurement.mc2p5, sps30_measurement.mc4p0, sps30_measurement.mc10p0,
-                                                    sps30_measurement.nc0p5, sps30_measurement.nc1p0, sps30_measurement.nc2p5, sps30_measurement.nc4p0,
-                                                    sps30_measurement.nc10p0, sps30_measurement.typicalParticleSize);
-    if (error != NO_ERROR) {
-        DEBUG_OUT.print("Could not read from SPS30");
-        sensorPayload.sps30Data.particles = -1;
-        sensorPayload.sps30Data.concentration = -1;
-    }else{
-        sensorPayload.sps30Data.particles = sps30_measurement.nc0p5;
-        sensorPayload.sps30Data.concentration = sps30_measurement.mc2p5;
+/**
+ * Flash logger task: writes the queued records and events, woken by the
+ * acquisition task.
+ */
+void loggerTaskMain(void* arg) {
+    SensorPayload record;
+    EventRecord event;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(logLock, portMAX_DELAY);
+        while (eventRing.pop(event)) {
+            #ifdef FLASH_MEM
+            if (loggingActive) {
+                logEventRecord(log_name, event);
+            }
+            #endif
+        }
+        while (loggerRing.pop(record)) {
+            #ifdef FLASH_MEM
+            if(loggingActive){
+                if (plumeCapture.enabled) {
+                    plumeCapture.feed(record);
+                } else {
+                    startLogRawStream(log_name, record);
+                }
+            }
+            #endif
+        }
+        xSemaphoreGive(logLock);
     }
-    time_taken[SPS30] = micros() - tStart_measure;
+}
 
-    handleButton();
+// UI consumer, in loop(): display, debug output and USB stream of new records
+void onRecord(uint32_t data, uint32_t time) {
+    Sample sample;
+    while (uiRing.pop(sample)) {
+        latestPayload = sample.payload;
+#ifdef DEBUG_OUT_ENABLED
+        printSample(sample);
+#endif
+        // Send the raw binary structure over USB
+        if (streamActive) {
+            streamRawPayload(sample.payload);
+        }
+    }
     systemDisplay(button_cnt);
+}
+
+void printSample(const Sample& sample) {
+    const SensorPayload& payload = sample.payload;
+    const uint32_t* time_taken = sample.time_taken;
+    DEBUG_OUT.printf("Reading - #%lu \n", (unsigned long)payload.counter);
+    DEBUG_OUT.printf("Timestamp: %lu ms\n", (unsigned long)payload.timestamp);
 
-#ifdef DEBUG_OUT_ENABLED
     // Print out the data for debugging
     DEBUG_OUT.println("SPS30 Data:");
-    DEBUG_OUT.printf(" - Polling Time: %d us\n", time_taken[SPS30]);
-    DEBUG_OUT.printf(" - Particles >0.5um: %d \n", sensorPayload.sps30Data.particles);
-    DEBUG_OUT.printf(" - Concentration PM2.5: %d µg/m3\n", sensorPayload.sps30Data.concentration);
+    DEBUG_OUT.printf(" - Polling Time: %lu us\n", (unsigned long)time_taken[SPS30]);
+    DEBUG_OUT.printf(" - Particles >0.5um: %d \n", payload.sps30Data.particles);
+    DEBUG_OUT.printf(" - Concentration PM2.5: %d µg/m3\n", payload.sps30Data.concentration);
 
     DEBUG_OUT.println("PMSA003I Data:");
-    DEBUG_OUT.printf(" - Polling Time: %d us\n", time_taken[PMSA003I]);
-    DEBUG_OUT.printf(" - Particles >0.3um: %d \n", sensorPayload.pmsa003iData.particles);
-    DEBUG_OUT.printf(" - Concentration PM2.5: %d µg/m3\n", sensorPayload.pmsa003iData.concentration);
+    DEBUG_OUT.printf(" - Polling Time: %lu us\n", (unsigned long)time_taken[PMSA003I]);
+    DEBUG_OUT.printf(" - Particles >0.3um: %d \n", payload.pmsa003iData.particles);
+    DEBUG_OUT.printf(" - Concentration PM2.5: %d µg/m3\n", payload.pmsa003iData.concentration);
 
     DEBUG_OUT.println("Cubic PM2012 Data:");
-    DEBUG_OUT.printf(" - Polling Time: %d us\n", time_taken[PM2012]);
-    DEBUG_OUT.printf(" - Particles >0.3um: %d \n", sensorPayload.cubicPm2012.particles);
-    DEBUG_OUT.printf(" - Concentration PM2.5 [GRIMM]: %d µg/m3\n", sensorPayload.cubicPm2012.concentration);
-    DEBUG_OUT.printf(" - Concentration PM2.5 [TSI]: %d µg/m3\n", sensorPayload.cubicPm2012Tsi);
+    DEBUG_OUT.printf(" - Polling Time: %lu us\n", (unsigned long)time_taken[PM2012]);
+    DEBUG_OUT.printf(" - Particles >0.3um: %d \n", payload.cubicPm2012.particles);
+    DEBUG_OUT.printf(" - Concentration PM2.5 [GRIMM]: %d µg/m3\n", payload.cubicPm2012.concentration);
+    DEBUG_OUT.printf(" - Concentration PM2.5 [TSI]: %d µg/m3\n", payload.cubicPm2012Tsi);
 
     DEBUG_OUT.println("Cubic PM2016 Data:");
-    DEBUG_OUT.printf(" - Polling Time: %d us\n", time_taken[PM2016]);
-    DEBUG_OUT.printf(" - Particles >0.3um: %d \n", sensorPayload.cubicPm2016.particles);
-    DEBUG_OUT.printf(" - Concentration PM2.5: %d µg/m3\n", sensorPayload.cubicPm2016.concentration);
+    DEBUG_OUT.printf(" - Polling Time: %lu us\n", (unsigned long)time_taken[PM2016]);
+    DEBUG_OUT.printf(" - Particles >0.3um: %d \n", payload.cubicPm2016.particles);
+    DEBUG_OUT.printf(" - Concentration PM2.5: %d µg/m3\n", payload.cubicPm2016.concentration);
+    xSemaphoreTake(sensorLock, portMAX_DELAY);
+    activeSensors.printStatus();
+    xSemaphoreGive(sensorLock);
     // DEBUG_OUT.printf("sensorPayload raw data: ");
     // for (int i = 0; i < sizeof(sensorPayload); i++) {
     //     DEBUG_OUT.printf("%02x ", ((uint8_t*)&sensorPayload)[i]);
     // }
-    loop_delay = millis()-sensorPayload.timestamp;
-    DEBUG_OUT.printf("\nTotal time (including screen & button): %d ms\n\n", loop_delay);
+    DEBUG_OUT.printf("\nPower since the last record: active %lu ms, idle %lu ms, sleep %lu ms, ~%lu nAh\n",
+                     (unsigned long)sample.powerTime[POWER_ACTIVE], (unsigned long)sample.powerTime[POWER_IDLE],
+                     (unsigned long)sample.powerTime[POWER_SLEEP], (unsigned long)sample.charge);
+    DEBUG_OUT.printf("Acquisition time: %lu ms, ring overflows: logger %lu, ui %lu\n\n",
+                     (unsigned long)sample.cycleTime, (unsigned long)loggerRing.overflows(),
+                     (unsigned long)uiRing.overflows());
+}
 
-#else
-    // Send the raw binary structure over UART
-    // Serial.write((uint8_t*)&sensorPayload, sizeof(sensorPayload));
-    #ifdef FLASH_MEM
-    if(loggingActive){
-        Serial.println("Action: Starting Data Log...");        
-        startLogRawStream(log_name, sensorPayload);
-    }
-    #endif
+// Ring fill levels, overflows and task stack headroom, for the "tasks" command
+void printTasks() {
+    Serial.printf("RING logger %u %lu\n", loggerRing.count(), (unsigned long)loggerRing.overflows());
+    Serial.printf("RING events %u %lu\n", eventRing.count(), (unsigned long)eventRing.overflows());
+    Serial.printf("RING ui %u %lu\n", uiRing.count(), (unsigned long)uiRing.overflows());
+    Serial.printf("TASK acquisition %lu\n", (unsigned long)uxTaskGetStackHighWaterMark(acquisitionTask));
+    Serial.printf("TASK logger %lu\n", (unsigned long)uxTaskGetStackHighWaterMark(loggerTask));
+    Serial.println("END");
+}
 
-#endif
+// Duty cycle and sensor power states, for the "duty" command
+void printDuty() {
+    xSemaphoreTake(sensorLock, portMAX_DELAY);
+    Serial.printf("DUTY %lu %lu\n", (unsigned long)dutyCycle.period / 1000, (unsigned long)dutyCycle.burst / 1000);
+    activeSensors.printPower(millis());
+    xSemaphoreGive(sensorLock);
+    Serial.println("END");
+}
+
+// External watchdog: a DONE pulse every WATCHDOG_INTERVAL, ended by a timer.
+// Not kicked while the acquisition task is stuck, so the watchdog resets the board.
+void kickWatchdog() {
+    if (millis() - lastCycleTime > ACQUISITION_STALL_TIME + BOOT_TIME) return;
+    digitalWrite(WATCHDOG_DONE_PIN,HIGH);
+    eventLoop.after(WATCHDOG_PULSE, releaseWatchdog);
+}
 
+void releaseWatchdog() {
+    digitalWrite(WATCHDOG_DONE_PIN,LOW);
 }
 
 
@@ -349,6 +497,13 @@ void loop() {
  * @param payload: The populated SensorPayload object.
  */
 void startLogRawStream(String new_log, const SensorPayload& payload) {
+    // Records of the session so far: events share the file, so the offset can't tell
+    static String countedLog = "";
+    static uint32_t records = 0;
+    if (new_log != countedLog) {
+        countedLog = new_log;
+        records = 0;
+    }
 
     // new_log = new_log + ".bin";
 
@@ -367,11 +522,22 @@ void startLogRawStream(String new_log, const SensorPayload& payload) {
         return;
     }else{
         // Cast the struct to a byte pointer (uint8_t*) and write its total size
+        uint32_t offset = file.size();
         size_t written = file.write((const uint8_t*)&payload, sizeof(SensorPayload));
         if (written != sizeof(SensorPayload)) {
-            Serial.printf("[-] Write Error! Expected %d bytes, wrote %d\n", sizeof(SensorPayload), written);
+            Serial.printf("[-] Write Error! Expected %lu bytes, wrote %lu\n", (unsigned long)sizeof(SensorPayload), (unsigned long)written);
         } else {
-            Serial.printf("[+] Logged Payload #%d (%d bytes)\n", payload.counter, written);
+            // Every LOG_INDEX_INTERVAL records, remember where this one starts
+            if (records++ % LOG_INDEX_INTERVAL == 0) {
+                File index = LittleFS.open(indexFileName(new_log), FILE_APPEND);
+                if (index) {
+                    LogIndexEntry entry = {payload.counter, payload.timestamp, offset};
+                    index.write((const uint8_t*)&entry, sizeof(LogIndexEntry));
+                    index.close();
+                } else {
+                    Serial.println("[-] Error: Could not open index for writing.");
+                }
+            }
         }
     }
 
@@ -379,6 +545,100 @@ void startLogRawStream(String new_log, const SensorPayload& payload) {
     file.close();
 }
 
+/**
+ * Appends an event to the session file, between the sensor records.
+ * @param event: The populated EventRecord.
+ */
+void logEventRecord(String new_log, const EventRecord& event) {
+    File file = LittleFS.open(new_log, FILE_APPEND);
+    if (!file) {
+        Serial.println("[-] Error: Could not open file for writing.");
+        return;
+    }
+    if (file.write((const uint8_t*)&event, sizeof(EventRecord)) != sizeof(EventRecord)) {
+        Serial.println("[-] Event write error!");
+    }
+    file.close();
+}
+
+// Plume capture output (logger task, or loop() with logLock held)
+void storeRecord(const SensorPayload& record) {
+    startLogRawStream(log_name, record);
+}
+
+void storeEvent(const EventRecord& event) {
+    logEventRecord(log_name, event);
+}
+
+/**
+ * Called by the SensorSet (acquisition task) when the duty cycle switches a sensor.
+ * @param slot: Sensor slot, see 'sensors'.
+ */
+void logPowerEvent(uint8_t slot, const char* name, bool on, uint32_t warmup) {
+    EventRecord event;
+    event.counter = sensorPayload.counter;
+    event.timestamp = millis();
+    event.type = EVENT_SENSOR_POWER;
+    event.source = slot;
+    event.data[0] = on;
+    event.data[1] = on ? warmup : 0;
+    event.data[2] = 0;
+    event.data[3] = 0;
+    if (on) {
+        Serial.printf("[+] %s on, warming up for %lu ms\n", name, (unsigned long)warmup);
+    } else {
+        Serial.printf("[+] %s off until the next burst\n", name);
+    }
+
+    // Written by the logger task with the next record
+    eventRing.push(event);
+}
+
+/**
+ * Called by the SensorSet (acquisition task) when a sensor gets isolated or recovers.
+ * @param slot: Sensor slot, see 'sensors'.
+ */
+void logHealthEvent(uint8_t slot, const char* name, const SensorHealth& health) {
+    EventRecord event;
+    event.counter = sensorPayload.counter;
+    event.timestamp = millis();
+    event.type = EVENT_SENSOR_HEALTH;
+    event.source = slot;
+    event.data[0] = health.state;
+    event.data[1] = health.failures;
+    event.data[2] = health.checksumErrors;
+    event.data[3] = health.latency;
+    if (health.isolated()) {
+        Serial.printf("[!] %s isolated after %u failed reads, probing again in %lu ms\n", name, health.failures,
+                      (unsigned long)health.backoff);
+    } else {
+        Serial.printf("[+] %s recovered\n", name);
+    }
+
+    // Written by the logger task with the next record
+    eventRing.push(event);
+}
+
+/**
+ * Sends one record to the host as a COBS frame. The 0x00 delimiters can't
+ * occur inside the frame, so the receiver resynchronizes on the next
+ * frame even when debug text or a damaged frame came before it.
+ * @param payload: The populated SensorPayload object.
+ */
+void streamRawPayload(const SensorPayload& payload) {
+    uint8_t frame[STREAM_FRAME_SIZE];
+    uint8_t encoded[COBS_MAX_ENCODED(STREAM_FRAME_SIZE) + 2];
+
+    memcpy(frame, &payload, sizeof(SensorPayload));
+    uint32_t crc = crc32Update(0, frame, sizeof(SensorPayload));
+    memcpy(frame + sizeof(SensorPayload), &crc, sizeof(crc));
+
+    encoded[0] = 0x00;
+    size_t len = cobsEncode(frame, sizeof(frame), encoded + 1) + 1;
+    encoded[len++] = 0x00;
+    Serial.write(encoded, len);
+}
+
 void stopLogRawStream() {
     File logFile;
     if (logFile) {
@@ -403,6 +663,11 @@ void readStoredLogs() {
     Serial.println("--- START OF FLASH LOGS ---");
 
     while (file) {
+        if (isIndexFile(file.name()) || isArchiveFile(file.name())) {
+            file.close();
+            file = root.openNextFile();
+            continue;
+        }
         Serial.println("-----------------------------------------");
         Serial.print("READING FILE: ");
         Serial.println(file.name());
@@ -421,11 +686,11 @@ void readStoredLogs() {
                     entry.terminater[0] == 0xaa && entry.terminater[1] == 0xbb) {
                     
                 #ifdef DEBUG_OUT_ENABLED
-                    Serial.printf("Count: %d | Time: %d ms\n", entry.counter, entry.timestamp);
-                    Serial.printf("  SPS30   : particles=%d concentration=%d\n", entry.sps30Data.particles, entry.sps30Data.concentration);
-                    Serial.printf("  PMSA003i: particles=%d concentration=%d\n", entry.pmsa003iData.particles, entry.pmsa003iData.concentration);
-                    Serial.printf("  PM2012A : particles=%d GRIMM_conc=%d, TSI_conc=%d\n", entry.cubicPm2012.particles, entry.cubicPm2012.concentration, entry.cubicPm2012Tsi);
-                    Serial.printf("  PM2016  : particles=%d concentration=%d\n", entry.cubicPm2016.particles, entry.cubicPm2016.concentration);
+                    printLogEntry(entry);
+                #endif
+                } else if (isEventRecord(entry)) {
+                #ifdef DEBUG_OUT_ENABLED
+                    printEventEntry((const EventRecord&)entry);
                 #endif
                 } else {
                     Serial.println("[!] Data corruption detected: Magic bytes don't match.");
@@ -450,30 +715,515 @@ void readStoredLogs() {
 
 }
 
-void ensureSpace() {
-    //Loop not break
-    while ((LittleFS.totalBytes() - LittleFS.usedBytes()) < MIN_FREE_SPACE) {
-        // Serial.printf("Free Disk space: %d\n", (LittleFS.totalBytes() - LittleFS.usedBytes()));
+void printLogEntry(const SensorPayload& entry) {
+    Serial.printf("Count: %lu | Time: %lu ms\n", (unsigned long)entry.counter, (unsigned long)entry.timestamp);
+    Serial.printf("  SPS30   : particles=%d concentration=%d\n", entry.sps30Data.particles, entry.sps30Data.concentration);
+    Serial.printf("  PMSA003i: particles=%d concentration=%d\n", entry.pmsa003iData.particles, entry.pmsa003iData.concentration);
+    Serial.printf("  PM2012A : particles=%d GRIMM_conc=%d, TSI_conc=%d\n", entry.cubicPm2012.particles, entry.cubicPm2012.concentration, entry.cubicPm2012Tsi);
+    Serial.printf("  PM2016  : particles=%d concentration=%d\n", entry.cubicPm2016.particles, entry.cubicPm2016.concentration);
+}
+
+void printEventEntry(const EventRecord& event) {
+    Serial.printf("Event %u | Count: %lu | Time: %lu ms\n", event.type,
+                  (unsigned long)event.counter, (unsigned long)event.timestamp);
+    Serial.printf("  source=%u data=%lu,%lu,%lu,%lu\n", event.source,
+                  (unsigned long)event.data[0], (unsigned long)event.data[1],
+                  (unsigned long)event.data[2], (unsigned long)event.data[3]);
+}
+
+// An EventRecord ('OE') read from a session in place of a SensorPayload
+bool isEventRecord(const SensorPayload& entry) {
+    return entry.header[0] == 0x4f && entry.header[1] == 0x45 &&
+           entry.terminater[0] == (char)0xaa && entry.terminater[1] == (char)0xbb;
+}
+
+/**
+ * Prints the records of one log session whose counter (or timestamp) lies
+ * in [from, to]. The sparse .idx file is used to seek close to the first
+ * record instead of reading the session from the start.
+ * @param fileName: Log session, e.g. "/pmLogs3.bin".
+ * @param byTime: true to select by timestamp [ms], false by counter.
+ */
+void queryStoredLogs(String fileName, bool byTime, uint32_t from, uint32_t to) {
+
+    File file = LittleFS.open(fileName, FILE_READ);
+    if (!file) {
+        if (LittleFS.exists(archiveFileName(fileName))) {
+            Serial.printf("[-] %s is archived, download it to query.\n", fileName.c_str());
+        } else {
+            Serial.printf("[-] No log file %s\n", fileName.c_str());
+        }
+        return;
+    }
+
+    // Binary search for the last index entry at or before 'from'
+    uint32_t offset = 0;
+    File index = LittleFS.open(indexFileName(fileName), FILE_READ);
+    if (index) {
+        LogIndexEntry entry;
+        int32_t lo = 0;
+        int32_t hi = (index.size() / sizeof(LogIndexEntry)) - 1;
+        while (lo <= hi) {
+            int32_t mid = (lo + hi) / 2;
+            index.seek(mid * sizeof(LogIndexEntry));
+            if (index.read((uint8_t*)&entry, sizeof(LogIndexEntry)) != sizeof(LogIndexEntry)) break;
+
+            uint32_t key = byTime ? entry.timestamp : entry.counter;
+            if (key <= from) {
+                offset = entry.offset;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        index.close();
+    }
+
+    Serial.printf("--- QUERY %s %s [%lu, %lu] from byte %lu ---\n", fileName.c_str(), byTime ? "time" : "counter",
+                  (unsigned long)from, (unsigned long)to, (unsigned long)offset);
+    file.seek(offset);
+
+    uint32_t matches = 0;
+    SensorPayload entry;
+    while (file.available() >= sizeof(SensorPayload)) {
+        if (file.read((uint8_t*)&entry, sizeof(SensorPayload)) != sizeof(SensorPayload)) break;
+        if (isEventRecord(entry)) {
+            const EventRecord& event = (const EventRecord&)entry;
+            uint32_t key = byTime ? event.timestamp : event.counter;
+            if (key >= from && key <= to) printEventEntry(event);
+            continue;
+        }
+        if (entry.header[0] != 0x4f || entry.header[1] != 0x41 ||
+            entry.terminater[0] != (char)0xaa || entry.terminater[1] != (char)0xbb) {
+            Serial.println("[!] Data corruption detected: Magic bytes don't match.");
+            continue;
+        }
+
+        uint32_t key = byTime ? entry.timestamp : entry.counter;
+        if (key > to) break;        // Records are appended in order
+        if (key < from) continue;
+        printLogEntry(entry);
+        matches++;
+    }
+    file.close();
+    Serial.printf("--- END OF QUERY (%lu records) ---\n", (unsigned long)matches);
+}
+
+/**
+ * Reads one line from the debug port without blocking and executes it.
+ * Usage:
+ *   "query /pmLogs0.bin counter 100 200" or "query /pmLogs0.bin time 60000 120000"
+ *   "id"                        -> "ID <mac>", identifies the device to the host
+ *   "ls"                        -> one "SESSION <name> <size> <first timestamp>" per file, then "END"
+ *   "get /pmLogs0.bin <offset>" -> binary download from <offset> (see TransferFrameHeader)
+ *   "get /pmLogs0.bin <offset> z" -> same, each frame's data LZSS compressed
+ *   "stream on" / "stream off"  -> live COBS-framed records (see streamRawPayload)
+ *   "blocks"                    -> "BLOCKS <address> <block size> <count> <bitmap>" (see sendBlockMap)
+ *   "ports"                     -> one "PORT <sensor> <uart> <rx> <tx> <baud> <use>" per UART sensor, then "END <switches>"
+ *   "port pms5003 0 5 8"        -> route a UART sensor to UART 0, RX pin 5, TX pin 8 (-1: default pins)
+ *   "health"                    -> one "HEALTH <sensor> <ok|isolated> <failures> <checksum errors> <latency us> <timeout ms>" per sensor, then "END"
+ *   "tasks"                     -> one "RING <consumer> <queued> <overflows>" per record ring, one "TASK <name> <free stack>" per task, then "END"
+ *   "power"                     -> "POWER <active|idle|sleep> <ms>", "POWER charge <uAh>", "POWER wakeups <timer> <gpio>",
+ *                                  "POWER jitter <max lateness ms> <guard ms>", then "END"
+ *   "duty"                      -> "DUTY <period s> <burst s>", one "SENSOR <sensor> <off|warming|on> <ms until warm>" per sensor, then "END"
+ *   "duty 300 60"               -> sample 60 s at the start of every 300 s, sensors off in between ("duty 0": always on)
+ *   "capture" / "capture on|off|now" -> "CAPTURE <on|off> <waiting|recording> <captures> <buffered records>"
+ */
+void handleSerialCommand() {
+    static char line[96];
+    static uint8_t len = 0;
+
+    while (DEBUG_OUT.available()) {
+        char c = DEBUG_OUT.read();
+        if (c != '\n' && c != '\r') {
+            if (len < sizeof(line) - 1) line[len++] = c;
+            continue;
+        }
+        if (len == 0) continue;
+        line[len] = '\0';
+        len = 0;
+
+        char cmd[16] = {0}, arg1[48] = {0}, arg2[16] = {0}, arg3[16] = {0}, arg4[16] = {0};
+        int args = sscanf(line, "%15s %47s %15s %15s %15s", cmd, arg1, arg2, arg3, arg4);
+        String path = arg1[0] == '/' ? String(arg1) : "/" + String(arg1);
+
+        if (strcmp(cmd, "query") == 0 && args == 5) {
+            queryStoredLogs(path, strcmp(arg2, "time") == 0, strtoul(arg3, NULL, 10), strtoul(arg4, NULL, 10));
+        } else if (strcmp(cmd, "id") == 0) {
+            Serial.printf("ID %012llx\n", ESP.getEfuseMac());
+        } else if (strcmp(cmd, "stream") == 0 && args >= 2) {
+            streamActive = strcmp(arg1, "on") == 0;
+        } else if (strcmp(cmd, "ls") == 0) {
+            listSessions();
+        } else if (strcmp(cmd, "get") == 0 && args >= 2) {
+            sendSession(path, args >= 3 ? strtoul(arg2, NULL, 10) : 0, args == 4 && strcmp(arg3, "z") == 0);
+        } else if (strcmp(cmd, "blocks") == 0) {
+            sendBlockMap();
+        } else if (strcmp(cmd, "health") == 0) {
+            xSemaphoreTake(sensorLock, portMAX_DELAY);
+            activeSensors.printHealth();
+            xSemaphoreGive(sensorLock);
+            Serial.println("END");
+        } else if (strcmp(cmd, "ports") == 0) {
+            xSemaphoreTake(sensorLock, portMAX_DELAY);
+            uartPorts.printRoutes();
+            xSemaphoreGive(sensorLock);
+        } else if (strcmp(cmd, "port") == 0 && args == 5) {
+            xSemaphoreTake(sensorLock, portMAX_DELAY);
+            int8_t sensor = uartPorts.find(arg1);
+            if (sensor < 0 || !uartPorts.remap(sensor, atoi(arg2), atoi(arg3), atoi(arg4))) {
+                Serial.printf("[-] Invalid port mapping: %s\n", line);
+            } else {
+                uartPorts.printRoutes();
+            }
+            xSemaphoreGive(sensorLock);
+        } else if (strcmp(cmd, "tasks") == 0) {
+            printTasks();
+        } else if (strcmp(cmd, "duty") == 0) {
+            if (args >= 2) {
+                uint32_t period = strtoul(arg1, NULL, 10) * 1000;
+                uint32_t burst = args >= 3 ? strtoul(arg2, NULL, 10) * 1000 : 0;
+                if (period > 0 && (burst == 0 || burst >= period)) {
+                    Serial.printf("[-] Invalid duty cycle: %s\n", line);
+                    continue;
+                }
+                xSemaphoreTake(sensorLock, portMAX_DELAY);
+                dutyCycle.period = period;
+                dutyCycle.burst = burst;
+                dutyCycle.epoch = nextSampleTime;   // The next burst starts with the next acquisition
+                xSemaphoreGive(sensorLock);
+            }
+            printDuty();
+        } else if (strcmp(cmd, "capture") == 0) {
+            xSemaphoreTake(logLock, portMAX_DELAY);
+            if (args >= 2 && strcmp(arg1, "on") == 0 && !plumeCapture.enabled) {
+                plumeCapture.reset();
+                plumeCapture.enabled = true;
+            } else if (args >= 2 && strcmp(arg1, "off") == 0 && plumeCapture.enabled) {
+                #ifdef FLASH_MEM
+                if (loggingActive) plumeCapture.flush();    // No gap before the records logged in full
+                #endif
+                plumeCapture.enabled = false;
+            } else if (args >= 2 && strcmp(arg1, "now") == 0) {
+                plumeCapture.request();
+            }
+            Serial.printf("CAPTURE %s %s %lu %u\n", plumeCapture.enabled ? "on" : "off",
+                          plumeCapture.recording() ? "recording" : "waiting", (unsigned long)plumeCapture.captures(),
+                          plumeCapture.buffered());
+            xSemaphoreGive(logLock);
+        } else if (strcmp(cmd, "power") == 0) {
+            powerManager.printStatus();
+            Serial.println("END");
+        } else {
+            Serial.printf("[-] Unknown command: %s\n", line);
+        }
+    }
+}
+
+/**
+ * Timer callback: polls the debug port every SERIAL_POLL_INTERVAL while a
+ * USB host is connected. Without one nothing can arrive, the poll slows to
+ * SERIAL_IDLE_POLL_INTERVAL so it doesn't keep the chip out of light sleep.
+ */
+void pollSerial() {
+    static bool connected = true;
+    if ((bool)DEBUG_OUT != connected) {
+        connected = DEBUG_OUT;
+        eventLoop.cancel(serialTimer);
+        serialTimer = eventLoop.every(connected ? SERIAL_POLL_INTERVAL : SERIAL_IDLE_POLL_INTERVAL, pollSerial);
+    }
+    handleSerialCommand();
+}
+
+void listSessions() {
+    File root = LittleFS.open("/");
+    File file = root.openNextFile();
+
+    while (file) {
+        // An archive is only complete once its session is gone
+        String name = file.name();
+        if (isArchiveFile(name) && LittleFS.exists("/" + name.substring(0, name.length() - 3) + ".bin")) {
+            file.close();
+            file = root.openNextFile();
+            continue;
+        }
+
+        // The first record's timestamp tells the host whether a name was reused
+        uint32_t firstTimestamp = 0;
+        SensorPayload first;
+        if (!isIndexFile(file.name()) &&
+            file.read((uint8_t*)&first, sizeof(SensorPayload)) == sizeof(SensorPayload)) {
+            firstTimestamp = first.timestamp;
+        }
+        Serial.printf("SESSION %s %lu %lu\n", file.name(), (unsigned long)file.size(), (unsigned long)firstTimestamp);
+        file.close();
+        file = root.openNextFile();
+    }
+    Serial.println("END");
+}
+
+/**
+ * Streams a file from 'offset' to its current end as CRC-protected frames,
+ * waiting for the host to acknowledge each one before sending the next.
+ * Gives up on a frame after MAX_BLOCK_RETRIES resends.
+ * @param fileName: Log session or index, e.g. "/pmLogs3.bin".
+ * @param offset: First byte to send (the host's sync cursor).
+ * @param compress: LZSS-compress every frame on its own. The header keeps the
+ *                  uncompressed offset, 'length' is the compressed size.
+ */
+void sendSession(String fileName, uint32_t offset, bool compress) {
+    static uint8_t chunk[TRANSFER_CHUNK_SIZE];
+    static uint8_t packed[LZSS_MAX_ENCODED(TRANSFER_CHUNK_SIZE)];
+
+    File file = LittleFS.open(fileName, FILE_READ);
+    if (!file) {
+        Serial.printf("[-] No log file %s\n", fileName.c_str());
+        return;
+    }
+
+    // Snapshot the size so a record appended meanwhile waits for the next sync
+    uint32_t end = file.size();
+    if (offset > end) offset = end;
+    file.seek(offset);
+
+    while (true) {
+        TransferFrameHeader frame;
+        frame.offset = offset;
+        uint16_t rawLength = min((uint32_t)TRANSFER_CHUNK_SIZE, end - offset);
+        if (file.read(chunk, rawLength) != rawLength) {
+            Serial.println("[-] Read error, transfer aborted.");
+            break;
+        }
+
+        const uint8_t* data = chunk;
+        frame.length = rawLength;
+        if (compress && rawLength > 0) {
+            LzssBufferSink sink(packed, sizeof(packed));
+            LzssEncoder encoder(sink, sizeof(SensorPayload));
+            encoder.write(chunk, rawLength);
+            encoder.finish();
+            data = packed;
+            frame.length = sink.length();
+        }
+
+        uint32_t crc = crc32Update(0, (const uint8_t*)&frame, sizeof(frame));
+        crc = crc32Update(crc, data, frame.length);
+
+        // Send until acknowledged, a link that keeps corrupting the frame gets an abort
+        bool acked = false;
+        for (uint8_t attempt = 0; !acked; attempt++) {
+            if (attempt > MAX_BLOCK_RETRIES) {
+                frame.length = TRANSFER_ABORT;
+                crc = crc32Update(0, (const uint8_t*)&frame, sizeof(frame));
+                Serial.write((const uint8_t*)&frame, sizeof(frame));
+                Serial.write((const uint8_t*)&crc, sizeof(crc));
+                Serial.flush();
+                file.close();
+                return;
+            }
+            Serial.write((const uint8_t*)&frame, sizeof(frame));
+            Serial.write(data, frame.length);
+            Serial.write((const uint8_t*)&crc, sizeof(crc));
+            Serial.flush();
+
+            unsigned long startWait = millis();
+            int reply = -1;
+            while (reply != TRANSFER_ACK && reply != TRANSFER_NAK && millis() - startWait < TRANSFER_ACK_TIMEOUT) {
+                reply = Serial.available() ? Serial.read() : -1;
+            }
+            if (reply == TRANSFER_ACK) {
+                acked = true;
+            } else if (reply != TRANSFER_NAK) {
+                file.close();
+                return;     // Host is gone, it resumes from its cursor next time
+            }
+        }
+
+        if (rawLength == 0) break;
+        offset += rawLength;
+    }
+    file.close();
+}
+
+/**
+ * Reports which blocks of the log partition hold data, so the host only has
+ * to read those with esptool. Erased flash reads as 0xFF, so a block counts
+ * as used as soon as one byte differs; this covers littlefs metadata and
+ * stale copies too, and the host can rebuild the exact image by filling the
+ * other blocks with 0xFF.
+ * littlefs does not erase the blocks of a removed file, and esp_littlefs
+ * gives no access to its block allocator, so a block stays "used" until it
+ * is reused and erased. Once ensureSpace() and archiveClosedSessions() have
+ * cycled through the partition the map is mostly set and a sparse read
+ * saves little over a full one.
+ * The bitmap is sent as hex, bit (i % 8) of byte (i / 8) set = block i used.
+ */
+void sendBlockMap() {
+    static uint32_t page[64];   // 256 bytes
+
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, LOG_PARTITION_LABEL);
+    if (!partition) {
+        Serial.printf("[-] No partition %s\n", LOG_PARTITION_LABEL);
+        return;
+    }
+
+    uint32_t blocks = partition->size / FLASH_BLOCK_SIZE;
+    Serial.printf("BLOCKS %lx %u %lu ", (unsigned long)partition->address, FLASH_BLOCK_SIZE, (unsigned long)blocks);
+
+    uint8_t bits = 0;
+    for (uint32_t block = 0; block < blocks; block++) {
+        bool used = false;
+        for (uint32_t offset = 0; offset < FLASH_BLOCK_SIZE && !used; offset += sizeof(page)) {
+            if (esp_partition_read(partition, block * FLASH_BLOCK_SIZE + offset, page, sizeof(page)) != ESP_OK) {
+                used = true;    // Let the host read it and find out
+                break;
+            }
+            for (uint8_t i = 0; i < sizeof(page) / sizeof(page[0]); i++) {
+                if (page[i] != 0xFFFFFFFF) {
+                    used = true;
+                    break;
+                }
+            }
+        }
+
+        if (used) bits |= 1 << (block % 8);
+        if (block % 8 == 7 || block == blocks - 1) {
+            Serial.printf("%02x", bits);
+            bits = 0;
+        }
+    }
+    Serial.println();
+}
+
+/**
+ * Compresses closed sessions into "pmLogsN.lz" archives, ARCHIVE_STEP_BYTES
+ * per call, and removes the session once its archive is complete. The .idx
+ * is kept: its offsets refer to the decompressed session.
+ * @return false if there was nothing to archive.
+ */
+bool archiveClosedSessions() {
+    static File input;
+    static File output;
+    static LzssEncoder* encoder = NULL;
+
+    if (encoder == NULL) {
+        // Find a session that is no longer written to
         File root = LittleFS.open("/");
         File file = root.openNextFile();
-        
-        if (!file) break; // No files left to delete
+        String session = "";
+        while (file && session == "") {
+            String name = "/" + String(file.name());
+            xSemaphoreTake(logLock, portMAX_DELAY);
+            bool open = loggingActive && name == log_name;
+            xSemaphoreGive(logLock);
+            if (name.endsWith(".bin") && !open) {
+                session = name;
+            }
+            file.close();
+            file = root.openNextFile();
+        }
+        if (session == "") return false;
+
+        input = LittleFS.open(session, FILE_READ);
+        output = LittleFS.open(archiveFileName(session), FILE_WRITE);  // Restarts an interrupted archive
+        if (!input || !output) {
+            Serial.printf("[-] Error: Could not archive %s\n", session.c_str());
+            input.close();
+            output.close();
+            return false;
+        }
+        LzssFileHeader header;
+        header.deltaStride = sizeof(SensorPayload);
+        header.originalSize = input.size();
+        output.write((const uint8_t*)&header, sizeof(header));
+        encoder = new LzssEncoder(output, sizeof(SensorPayload));
+    }
 
-        String oldestFile = file.name();
-        file.close();
+    uint8_t buf[ARCHIVE_STEP_BYTES];
+    size_t n = input.read(buf, sizeof(buf));
+    encoder->write(buf, n);
+    if (input.available() > 0) return true;
+
+    encoder->finish();
+    String session = String("/") + input.name();
+    Serial.printf("[+] Archived %s: %lu -> %lu bytes\n", session.c_str(), (unsigned long)encoder->bytesIn(),
+                  (unsigned long)encoder->bytesOut());
+    delete encoder;
+    encoder = NULL;
+    input.close();
+    output.close();
+    LittleFS.remove(session);
+    return true;
+}
+
+// Timer callback: archive steps every ARCHIVE_INTERVAL while there is work,
+// otherwise look again for a closed session after ARCHIVE_IDLE_INTERVAL
+void archiveStep() {
+    eventLoop.after(archiveClosedSessions() ? ARCHIVE_INTERVAL : ARCHIVE_IDLE_INTERVAL, archiveStep);
+}
 
-        Serial.print("Low space! Deleting oldest: ");
-        Serial.println(oldestFile);
-        LittleFS.remove(oldestFile);
-        delay(100);
+// "/pmLogs3.bin" -> "/pmLogs3.idx"
+String indexFileName(String log_name) {
+    int dot = log_name.lastIndexOf('.');
+    if (dot > 0) {
+        log_name.remove(dot);
     }
+    return log_name + ".idx";
+}
+
+// "/pmLogs3.bin" -> "/pmLogs3.lz"
+String archiveFileName(String log_name) {
+    int dot = log_name.lastIndexOf('.');
+    if (dot > 0) {
+        log_name.remove(dot);
+    }
+    return log_name + ".lz";
+}
+
+bool isIndexFile(String fileName) {
+    return fileName.endsWith(".idx");
+}
+
+bool isArchiveFile(String fileName) {
+    return fileName.endsWith(".lz");
+}
+
+/**
+ * Deletes the oldest session while the free space is below MIN_FREE_SPACE,
+ * one per call: re-arms itself every SPACE_CHECK_INTERVAL until done.
+ */
+void ensureSpace() {
+    if ((LittleFS.totalBytes() - LittleFS.usedBytes()) >= MIN_FREE_SPACE) return;
+
+    // Serial.printf("Free Disk space: %d\n", (LittleFS.totalBytes() - LittleFS.usedBytes()));
+    File root = LittleFS.open("/");
+    File file = root.openNextFile();
+
+    if (!file) return; // No files left to delete
+
+    String oldestFile = file.name();
+    file.close();
+    if (!oldestFile.startsWith("/")) oldestFile = "/" + oldestFile;
+
+    Serial.print("Low space! Deleting oldest: ");
+    Serial.println(oldestFile);
+    LittleFS.remove(oldestFile);
+    // Drop the session's data and index together
+    String base = oldestFile.substring(0, oldestFile.lastIndexOf('.'));
+    LittleFS.remove(base + ".bin");
+    LittleFS.remove(base + ".lz");
+    LittleFS.remove(base + ".idx");
+    eventLoop.after(SPACE_CHECK_INTERVAL, ensureSpace);
 }
 
 String startNewLogFile(String log_name) {
 
-    // Find the next available ID
+    // Find the next available ID. An archived session has no .bin any more but
+    // keeps its .lz and .idx, reusing its ID would overwrite them.
     int fileID = 0;
-    while (LittleFS.exists(log_name + String(fileID) + ".bin")) {   // "/log_"
+    while (LittleFS.exists(log_name + String(fileID) + ".bin") ||   // "/log_"
+           LittleFS.exists(log_name + String(fileID) + ".lz") ||
+           LittleFS.exists(log_name + String(fileID) + ".idx")) {
         fileID++;
     }
 
@@ -492,50 +1242,97 @@ String startNewLogFile(String log_name) {
     // return "";
 }
 
-void handleButton() {
-
-    // --- 1. Continuous Long Press Check (Real-time 5s trigger) ---
-    if (buttonPressed && digitalRead(BUTTON_PIN) == LOW) {
-        if (millis() - pressStartTime >= 5000) {
-            digitalWrite(LED_PIN,HIGH);
-            delay(100);
-            digitalWrite(LED_PIN,LOW);
-            delay(100);
-            digitalWrite(LED_PIN,HIGH);
-            delay(100);
-            digitalWrite(LED_PIN,LOW);
-            delay(100);
-            loggingActive = !loggingActive;     // Enable/Disable logging function
-            buttonPressed = false;              // Reset to prevent double trigger
-            Serial.printf(">>> LOGGING = %s<<<\n", loggingActive ? "START":"STOP");
-
-            // check flash space -> auto circular file (delete oldest file)
-            ensureSpace();
-            // create file name
-            log_name = startNewLogFile("/pmLogs");
-        
-            // startLogging(loggingActive); // Trigger Long Press Action
-        }
+void onButtonDown(uint32_t data, uint32_t time) {
+    if (buttonDown) return;
+    if (time - lastButtonEdge < BUTTON_DEBOUNCE) {
+        debounceButton();
+        return;
     }
+    lastButtonEdge = time;
+    buttonDown = true;
+    pressStartTime = time;
+    // Fires while the button is still held (real-time 5s trigger)
+    longPressTimer = eventLoop.after(LONG_PRESS_TIME, onLongPress);
+}
 
-    // --- 2. Short Press Check (On Release) ---
-    if (buttonReleased) {
-        // Serial.printf("Press duration = %d\n", button_duration);
-        // Only trigger if it wasn't already caught by the long-press logic
-        if (// button_duration > 50 && 
-            button_duration < 1000) {
-            Serial.println(">>> CHANGE SCREEN <<<");
-            changeScreen(&button_cnt);
-        } 
-        
-        // If we were logging and released, we can stop or just reset flags
-        if (loggingActive && button_duration >= 5000) {
-            Serial.println("Logging session confirmed.");
-        }
-        buttonPressed = false;
-        buttonReleased = false;
+void onButtonUp(uint32_t data, uint32_t time) {
+    if (!buttonDown) return;
+    if (time - lastButtonEdge < BUTTON_DEBOUNCE) {
+        debounceButton();
+        return;
+    }
+    lastButtonEdge = time;
+    buttonDown = false;
+    eventLoop.cancel(longPressTimer);
+
+    uint32_t button_duration = time - pressStartTime;
+    // Serial.printf("Press duration = %d\n", button_duration);
+    if (button_duration < SHORT_PRESS_TIME) {
+        Serial.println(">>> CHANGE SCREEN <<<");
+        changeScreen(&button_cnt);
+        systemDisplay(button_cnt);
+    } else if (button_duration < LONG_PRESS_TIME && plumeCapture.enabled) {
+        Serial.println(">>> CAPTURE <<<");
+        plumeCapture.request();
     }
 
+    // If we were logging and released, we can stop or just reset flags
+    if (loggingActive && button_duration >= LONG_PRESS_TIME) {
+        Serial.println("Logging session confirmed.");
+    }
+}
+
+// An edge came within BUTTON_DEBOUNCE of the last one: it may be bounce or
+// a short tap's real release, so the pin is read again once it has settled
+void debounceButton() {
+    if (!eventLoop.active(debounceTimer)) {
+        debounceTimer = eventLoop.after(BUTTON_DEBOUNCE, resampleButton);
+    }
+}
+
+void resampleButton() {
+    debounceTimer = TIMER_NONE;         // Expired, the id may be reused
+    eventLoop.post(digitalRead(BUTTON_PIN) == LOW ? LOOP_BUTTON_DOWN : LOOP_BUTTON_UP);
+}
+
+void onLongPress() {
+    longPressTimer = TIMER_NONE;        // Expired, the id may be reused
+    blinkLed(2);
+    xSemaphoreTake(logLock, portMAX_DELAY);
+    #ifdef FLASH_MEM
+    if (loggingActive && plumeCapture.enabled) plumeCapture.flush();    // Held back records of the closing session
+    #endif
+    plumeCapture.reset();
+    loggingActive = !loggingActive;     // Enable/Disable logging function
+    Serial.printf(">>> LOGGING = %s<<<\n", loggingActive ? "START":"STOP");
+
+    // check flash space -> auto circular file (delete oldest file)
+    ensureSpace();
+    // create file name
+    log_name = startNewLogFile("/pmLogs");
+    xSemaphoreGive(logLock);
+
+    // startLogging(loggingActive); // Trigger Long Press Action
+}
+
+/**
+ * Blinks the LED on the event loop's timer.
+ * @param count: Number of blinks, LED_BLINK_TIME on and off.
+ */
+void blinkLed(uint8_t count) {
+    eventLoop.cancel(ledTimer);
+    ledToggles = 2 * count;
+    ledStep();
+    ledTimer = eventLoop.every(LED_BLINK_TIME, ledStep, LED_BLINK_TIME);
+}
+
+void ledStep() {
+    if (ledToggles == 0) {
+        eventLoop.cancel(ledTimer);
+        return;
+    }
+    ledToggles--;
+    digitalWrite(LED_PIN, ledToggles % 2 ? HIGH : LOW);
 }
 
 void startLogging(bool enable){
@@ -589,7 +1386,7 @@ void displayPmValue(){
     display.setTextSize(1);
     display.setTextColor(SH110X_WHITE);
     display.setCursor(0, 0);
-    display.printf("Time: %4ds Meas:%4d", sensorPayload.timestamp/1000, sensorPayload.counter);
+    display.printf("Time: %4ds Meas:%4d", latestPayload.timestamp/1000, latestPayload.counter);
 
     // 2. Horizontal Divider
     display.drawLine(0, 10, 128, 10, SH110X_WHITE);
@@ -597,10 +1394,10 @@ void displayPmValue(){
     // 3. PM Readings (Larger text for visibility)
     display.setTextSize(1);
     display.setCursor(0, 17);  //  x: 128/4-6-6, y: 64/2
-    display.printf("SPS30  : %3d, %4d\n", sensorPayload.sps30Data.concentration, sensorPayload.sps30Data.particles);
-    display.printf("003i   : %3d, %4d\n", sensorPayload.pmsa003iData.concentration, sensorPayload.pmsa003iData.particles);
-    display.printf("Cubic_S: %3d, %4d\n", sensorPayload.cubicPm2012.concentration, sensorPayload.cubicPm2012.particles);
-    display.printf("Cubic_L: %3d, %4d\n", sensorPayload.cubicPm2016.concentration, sensorPayload.cubicPm2016.particles);
+    display.printf("SPS30  : %3d, %4d\n", latestPayload.sps30Data.concentration, latestPayload.sps30Data.particles);
+    display.printf("003i   : %3d, %4d\n", latestPayload.pmsa003iData.concentration, latestPayload.pmsa003iData.particles);
+    display.printf("Cubic_S: %3d, %4d\n", latestPayload.cubicPm2012.concentration, latestPayload.cubicPm2012.particles);
+    display.printf("Cubic_L: %3d, %4d\n", latestPayload.cubicPm2016.concentration, latestPayload.cubicPm2016.particles);
     // display.setCursor(12, 25);  //  x: 128/4-6-6, y: 64/2 
     // display.setCursor(84, 17);  //  x: 128*3/4-6-6, y: 64/2
     // display.setCursor(76, 25);  //  x: 128/4-6-6, y: 64/2 
@@ -667,9 +1464,11 @@ void displayFilesSystem(){
     File root = LittleFS.open("/");
     File file = root.openNextFile();
 
-    // 1. Collect all filenames
+    // 1. Collect all filenames (sessions only, indexes are listed with them)
     while (file) {
-        fileList.push_back(String(file.name()));
+        if (!isIndexFile(file.name())) {
+            fileList.push_back(String(file.name()));
+        }
         file = root.openNextFile();
     }
 
@@ -736,7 +1535,7 @@ int getFileList() {
     File file = root.openNextFile();
 
     while (file) {
-        fileCount++;
+        if (!isIndexFile(file.name())) fileCount++;
 
         #ifdef DEBUG_OUT_ENABLED
         // Print file details
@@ -1,18 +1,27 @@
 #ifndef OpenAirMultiSense_h
 #define OpenAirMultiSense_h
 
+#ifdef ARDUINO
 #include <Wire.h>
-#include "PMS.h"
+#include "PMS_custom.h"
 #include "Adafruit_PM25AQI.h"
-#include "SensirionUartSps30.h"
-#include "pm2008_i2c.h"
+#include "cubicPmI2c.h"
 #include "cubicPmUart.h"
+#include "sps30Shdlc.h"
+#include "crc32.h"
+#include "cobs.h"
+#include "lzss.h"
 #include "FS.h"
 #include "LittleFS.h"
+#include "esp_partition.h"
 #include <Adafruit_GFX.h>
 #include <Adafruit_SH110X.h>
 #include <vector>
 #include <algorithm>
+#else
+// Host tools (tools/logReader) include this header for the record layouts only
+#include <stdint.h>
+#endif
 
 // AirGradient Open Air ESP32C3 - Pin Map
 #define UART2_RX            0
@@ -24,6 +33,13 @@
 #define I2C_SCL_PIN         6
 #define BUTTON_PIN          9
 #define LED_PIN             10  // Standard for AirGradient/C3-Mini
+// Every UART sensor has its own RX/TX pair, sensors sharing a port get the
+// port's pins routed to them in turn (uartPorts.cpp). The SPS30 uses the
+// default Serial0 pins (RX 20, TX 21).
+#define PMS5003_RX          5
+#define PMS5003_TX          8   // Strapping pin, a UART TX idles high as boot needs
+#define PMS7003_RX          PMSA003I_SET_PIN    // PMSA003I header: only when no
+#define PMS7003_TX          PMSA003I_RESET_PIN  // PMSA003I is in the sensor set
 
 // I2C Address is usually 0x3C or 0x3D
 #define i2c_Address 0x3C 
@@ -38,19 +54,6 @@ enum sensors{
     PM2016
 };
 
-struct SensirionMeasurement {
-    uint16_t mc1p0;
-    uint16_t mc2p5;
-    uint16_t mc4p0;
-    uint16_t mc10p0;
-    uint16_t nc0p5;
-    uint16_t nc1p0;
-    uint16_t nc2p5;
-    uint16_t nc4p0;
-    uint16_t nc10p0;
-    uint16_t typicalParticleSize;
-};
-
 // Log only PM2.5 or above particles size
 struct __attribute__((packed)) SensorData {
     uint16_t particles;         // 2 bytes for number of particles
@@ -70,4 +73,72 @@ struct __attribute__((packed)) SensorPayload {
     char terminater[2] = {0xaa, 0xbb};    // 2 bytes
 };
 
+// Events are logged in the session file between the SensorPayload records,
+// with the same size and terminator but header 'OE'. Decoders that only look
+// for 'OA' records skip them.
+#define EVENT_SENSOR_HEALTH     1   // source: sensor slot, data: healthState, consecutive failures,
+                                    //         checksum errors, smoothed latency [us]
+#define EVENT_POWER             2   // source: largest sample lateness [ms] since the last one,
+                                    // data: time active, idle, asleep [ms] and estimated charge [uAh],
+                                    //       all since boot
+#define EVENT_SENSOR_POWER      3   // source: sensor slot, data: 1 on / 0 off (duty cycle),
+                                    //         warm-up [ms] before its readings are used again
+#define EVENT_CAPTURE           4   // source: sensor slot of the plume, 0xFF requested, data: 1 start / 0 end,
+                                    //         first / last record in full, signal (0 PM2.5, 1 particles,
+                                    //         2 requested), value that triggered
+
+// Total size = 30 bytes
+struct __attribute__((packed)) EventRecord {
+    char header[2] = {0x4f, 0x45};  // 2 bytes  'OE'
+    uint32_t counter;               // 4 bytes  counter of the last SensorPayload
+    uint32_t timestamp;             // 4 bytes  [ms]
+    uint8_t type;                   // 1 byte   EVENT_...
+    uint8_t source;                 // 1 byte   what the event is about
+    uint32_t data[4];               // 16 bytes depends on the type
+    char terminater[2] = {0xaa, 0xbb};    // 2 bytes
+};
+
+// Sparse index written next to every log session ("pmLogsN.idx"),
+// one entry for every LOG_INDEX_INTERVAL records of "pmLogsN.bin".
+#define LOG_INDEX_INTERVAL  32
+
+// Total size = 12 bytes
+struct __attribute__((packed)) LogIndexEntry {
+    uint32_t counter;               // 4 bytes  counter of the indexed record
+    uint32_t timestamp;             // 4 bytes  [ms]
+    uint32_t offset;                // 4 bytes  byte offset of the record in the .bin file
+};
+
+// Download service ("get" command): a session is sent in frames of up to
+// TRANSFER_CHUNK_SIZE bytes. Each frame is TransferFrameHeader + data +
+// uint32_t CRC-32 over header and data, and the host answers every frame
+// with TRANSFER_ACK (next frame) or TRANSFER_NAK (send it again).
+// A frame with length 0 marks the end of the session. A frame NAKed
+// MAX_BLOCK_RETRIES times ends the transfer with an abort frame: length
+// TRANSFER_ABORT, no data, CRC-32 over the header; the host resumes from
+// its cursor next time.
+#define TRANSFER_CHUNK_SIZE     4096
+#define TRANSFER_ACK_TIMEOUT    2000    // [ms]
+#define TRANSFER_ACK            'A'
+#define TRANSFER_NAK            'N'
+#define TRANSFER_ABORT          0xFFFF
+#define MAX_BLOCK_RETRIES       5
+
+// Total size = 8 bytes
+struct __attribute__((packed)) TransferFrameHeader {
+    char magic[2] = {0x4f, 0x44};   // 2 bytes  'OD'
+    uint32_t offset;                // 4 bytes  byte offset of the data in the session
+    uint16_t length;                // 2 bytes  number of data bytes that follow
+};
+
+// Live stream ("stream on"): every SensorPayload is sent as
+// 0x00 + COBS(payload + uint32_t CRC-32 of payload) + 0x00
+#define STREAM_FRAME_SIZE   (sizeof(SensorPayload) + sizeof(uint32_t))
+
+// Used-block map ("blocks" command): one bit per FLASH_BLOCK_SIZE block of
+// the log partition, set when the block is not erased (not all 0xFF). Blocks
+// of removed files count as used until littlefs reuses them.
+#define FLASH_BLOCK_SIZE    4096
+#define LOG_PARTITION_LABEL "spiffs"
+
 #endif  // OpenAirMultiSense.h
\ No newline at end of file
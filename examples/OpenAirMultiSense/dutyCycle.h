@@ -0,0 +1,60 @@
+#ifndef dutyCycle_h
+#define dutyCycle_h
+
+#include <Arduino.h>
+
+// Sensor duty cycle for long unattended sessions: records are only taken in
+// a burst at the start of every period, the sensors' fans and lasers are off
+// in between. Every sensor is switched on its own warm-up time before the
+// burst, so all of them are stable when it starts and the bursts of the
+// different sensors line up. A sensor whose warm-up is longer than the off
+// time stays on. Readings of a sensor that is off or still warming up are
+// not taken, the record holds SENSOR_VALUE_INVALID for it.
+//   phase  0 ........ burst ................ period - warm-up ...... period
+//          | sampling |          off         |  warming up (not read) |
+struct DutyCycle {
+    uint32_t period = 0;        // [ms] 0: sensors always on, records every READ_INTERVAL
+    uint32_t burst = 0;         // [ms] sampled at the start of every period
+    uint32_t epoch = 0;         // millis() of the start of a burst
+
+    bool enabled() const { return period > 0 && burst < period; }
+
+    uint32_t phase(uint32_t now) const { return (now - epoch) % period; }
+
+    // Records are taken at 'now'
+    bool sampling(uint32_t now) const { return !enabled() || phase(now) < burst; }
+
+    // A sensor with this warm-up [ms] has its fan and laser on at 'now'
+    bool powered(uint32_t now, uint32_t warmup) const {
+        if (!enabled() || warmup >= period - burst) return true;
+        uint32_t p = phase(now);
+        return p < burst || p >= period - warmup;
+    }
+
+    // [ms] until the next burst starts, 0 while sampling
+    uint32_t untilBurst(uint32_t now) const {
+        if (sampling(now)) return 0;
+        return period - phase(now);
+    }
+
+    // [ms] until powered() changes for a sensor with this warm-up, UINT32_MAX if never
+    uint32_t untilSwitch(uint32_t now, uint32_t warmup) const {
+        if (!enabled() || warmup >= period - burst) return UINT32_MAX;
+        uint32_t p = phase(now);
+        if (p < burst) return burst - p;
+        if (p >= period - warmup) return period - p + burst;
+        return period - warmup - p;
+    }
+};
+
+// Fan/laser state of one sensor, kept by the SensorSet. Only a power-up by
+// the duty cycle starts a warm-up, at boot the readings are used at once.
+struct SensorPower {
+    bool on = true;
+    bool warming = false;
+    uint32_t validFrom = 0;     // millis() when the warm-up ends
+
+    bool warm(uint32_t now) const { return on && (!warming || (int32_t)(now - validFrom) >= 0); }
+};
+
+#endif  // dutyCycle.h
@@ -0,0 +1,161 @@
+#include "eventLoop.h"
+
+#define LEVEL1_FIRST    TIMER_WHEEL_SLOTS                       // Slot index of level 1
+#define LEVEL2_FIRST    (TIMER_WHEEL_SLOTS + TIMER_LEVEL_SLOTS)
+#define LEVEL1_RANGE    (1UL << (TIMER_WHEEL_BITS + TIMER_LEVEL_BITS))
+
+EventLoop eventLoop;
+
+static portMUX_TYPE queueLock = portMUX_INITIALIZER_UNLOCKED;
+
+TimerWheel::TimerWheel() : tick(0) {
+    for (uint8_t i = 0; i < TIMER_COUNT; i++) timers[i].callback = NULL;
+    for (uint16_t i = 0; i < sizeof(slots); i++) slots[i] = TIMER_NONE;
+}
+
+int8_t TimerWheel::start(uint32_t delay, uint32_t period, TimerCallback callback) {
+    int8_t id = TIMER_NONE;
+    bool idle = true;
+    for (int8_t i = 0; i < TIMER_COUNT; i++) {
+        if (timers[i].callback == NULL) {
+            if (id == TIMER_NONE) id = i;
+        } else {
+            idle = false;
+        }
+    }
+    if (id == TIMER_NONE) {
+        Serial.println("[-] Error: No free timer");
+        return TIMER_NONE;
+    }
+
+    uint32_t now = millis();
+    if (idle) tick = now;           // Nothing pending, skip the ticks since the last timer
+    Timer& timer = timers[id];
+    timer.expires = now + min(delay, (uint32_t)TIMER_MAX_DELAY);
+    timer.period = min(period, (uint32_t)TIMER_MAX_DELAY);
+    timer.callback = callback;
+    insert(id);
+    return id;
+}
+
+void TimerWheel::cancel(int8_t& id) {
+    if (active(id)) {
+        unlink(id);
+        timers[id].callback = NULL;
+    }
+    id = TIMER_NONE;
+}
+
+void TimerWheel::advance(uint32_t now) {
+    while ((int32_t)(now - tick) >= 0) {
+        uint16_t index = tick & (TIMER_WHEEL_SLOTS - 1);
+        if (index == 0) {
+            // Level 0 wrapped: move the timers of the next 256 ms down from level 1,
+            // and every 64th time those of the next 16 s down from level 2
+            if (((tick >> TIMER_WHEEL_BITS) & (TIMER_LEVEL_SLOTS - 1)) == 0) cascade(2);
+            cascade(1);
+        }
+        tick++;                     // Timers started by the callbacks expire later
+
+        while (slots[index] != TIMER_NONE) {
+            int8_t id = slots[index];
+            Timer& timer = timers[id];
+            slots[index] = timer.next;
+            TimerCallback callback = timer.callback;
+            if (timer.period) {
+                timer.expires += timer.period;      // No drift
+                if ((int32_t)(timer.expires - now) <= 0) {
+                    // Late by a period or more: skip the missed calls
+                    timer.expires += ((now - timer.expires) / timer.period + 1) * timer.period;
+                }
+                insert(id);
+            } else {
+                timer.callback = NULL;
+            }
+            callback();
+        }
+    }
+}
+
+uint32_t TimerWheel::idleTime(uint32_t now) const {
+    uint32_t idle = TIMER_MAX_DELAY;
+    for (uint8_t i = 0; i < TIMER_COUNT; i++) {
+        if (timers[i].callback == NULL) continue;
+        int32_t left = timers[i].expires - now;
+        if (left <= 0) return 0;
+        idle = min(idle, (uint32_t)left);
+    }
+    return idle;
+}
+
+void TimerWheel::insert(int8_t id) {
+    Timer& timer = timers[id];
+    int32_t delta = timer.expires - tick;
+    if (delta < 0) {
+        timer.expires = tick;       // Overdue: on the next tick processed
+        delta = 0;
+    } else if ((uint32_t)delta > TIMER_MAX_DELAY) {
+        timer.expires = tick + TIMER_MAX_DELAY;     // Started while advance() catches up
+        delta = TIMER_MAX_DELAY;
+    }
+
+    if ((uint32_t)delta < TIMER_WHEEL_SLOTS) {
+        timer.slot = timer.expires & (TIMER_WHEEL_SLOTS - 1);
+    } else if ((uint32_t)delta < LEVEL1_RANGE) {
+        timer.slot = LEVEL1_FIRST + ((timer.expires >> TIMER_WHEEL_BITS) & (TIMER_LEVEL_SLOTS - 1));
+    } else {
+        timer.slot = LEVEL2_FIRST + ((timer.expires >> (TIMER_WHEEL_BITS + TIMER_LEVEL_BITS)) & (TIMER_LEVEL_SLOTS - 1));
+    }
+    timer.next = slots[timer.slot];
+    slots[timer.slot] = id;
+}
+
+void TimerWheel::unlink(int8_t id) {
+    int8_t* link = &slots[timers[id].slot];
+    while (*link != TIMER_NONE && *link != id) link = &timers[*link].next;
+    if (*link == id) *link = timers[id].next;
+}
+
+void TimerWheel::cascade(uint8_t level) {
+    uint8_t shift = TIMER_WHEEL_BITS + (level - 1) * TIMER_LEVEL_BITS;
+    uint16_t slot = (level == 1 ? LEVEL1_FIRST : LEVEL2_FIRST) + ((tick >> shift) & (TIMER_LEVEL_SLOTS - 1));
+    int8_t id = slots[slot];
+    slots[slot] = TIMER_NONE;
+    while (id != TIMER_NONE) {
+        int8_t next = timers[id].next;
+        insert(id);
+        id = next;
+    }
+}
+
+EventLoop::EventLoop() {
+    for (uint8_t i = 0; i < EVENT_TYPE_COUNT; i++) handlers[i] = NULL;
+}
+
+bool IRAM_ATTR EventLoop::post(uint8_t type, uint32_t data) {
+    // The lock keeps an interrupt from posting in the middle of a post() from the loop
+    portENTER_CRITICAL_SAFE(&queueLock);
+    uint8_t next = (head + 1) & (EVENT_QUEUE_SIZE - 1);
+    bool queued = next != tail;
+    if (queued) {
+        queue[head].type = type;
+        queue[head].data = data;
+        queue[head].time = millis();
+        head = next;
+    } else {
+        droppedEvents++;
+    }
+    portEXIT_CRITICAL_SAFE(&queueLock);
+    return queued;
+}
+
+void EventLoop::run() {
+    while (tail != head) {
+        Event event = queue[tail];
+        tail = (tail + 1) & (EVENT_QUEUE_SIZE - 1);
+        if (event.type < EVENT_TYPE_COUNT && handlers[event.type] != NULL) {
+            handlers[event.type](event.data, event.time);
+        }
+    }
+    wheel.advance(millis());
+}
@@ -0,0 +1,120 @@
+#ifndef eventLoop_h
+#define eventLoop_h
+
+#include <Arduino.h>
+
+// Cooperative event loop: everything that isn't sensor I/O runs as a short
+// callback instead of waiting with delay().
+//  - Timers live in a hierarchical timer wheel with 1 ms ticks: 256 slots for
+//    the next 256 ms, then two levels of 64 slots (16 s, 17 min) that are
+//    cascaded down as time passes. Starting, cancelling and expiring a timer
+//    is O(1), advancing costs one slot check per elapsed tick. Periods a
+//    timer missed while the loop was blocked or asleep are skipped.
+//  - Interrupts post small events to a queue, the handlers run in loop context.
+// run() dispatches the queued events, then the due timers, in loop().
+#define TIMER_WHEEL_BITS        8       // Level 0: 256 x 1 ms
+#define TIMER_LEVEL_BITS        6       // Levels 1, 2: 64 x 256 ms, 64 x 16384 ms
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_BITS)
+#define TIMER_LEVEL_SLOTS       (1 << TIMER_LEVEL_BITS)
+#define TIMER_MAX_DELAY         ((1UL << (TIMER_WHEEL_BITS + 2 * TIMER_LEVEL_BITS)) - 1)    // [ms] ~17 min
+#define TIMER_COUNT             16      // Timers that can be active at once
+#define TIMER_NONE              -1
+
+#define EVENT_QUEUE_SIZE        16      // Power of 2
+#define EVENT_TYPE_COUNT        8
+
+typedef void (*TimerCallback)();
+
+/**
+ * Handles a queued event.
+ * @param data: As posted.
+ * @param time: millis() when it was posted.
+ */
+typedef void (*EventHandler)(uint32_t data, uint32_t time);
+
+class TimerWheel {
+public:
+    TimerWheel();
+
+    /**
+     * Arms a timer, delays above TIMER_MAX_DELAY are shortened to it.
+     * @param delay: [ms] until the first call.
+     * @param period: [ms] between the following calls, 0 for a one-shot timer.
+     * @return Timer id, TIMER_NONE if all TIMER_COUNT timers are in use.
+     */
+    int8_t start(uint32_t delay, uint32_t period, TimerCallback callback);
+
+    // Disarms the timer and sets the id to TIMER_NONE, nothing if it already expired
+    void cancel(int8_t& id);
+
+    bool active(int8_t id) const { return id != TIMER_NONE && timers[id].callback != NULL; }
+
+    // Runs the timers that expired up to 'now' in expiry order
+    void advance(uint32_t now);
+
+    // [ms] from 'now' until the next timer expires, TIMER_MAX_DELAY if none is active
+    uint32_t idleTime(uint32_t now) const;
+
+private:
+    struct Timer {
+        uint32_t expires;           // [tick]
+        uint32_t period;
+        TimerCallback callback;     // NULL: free
+        int8_t next;                // In the slot's list
+        int16_t slot;
+    };
+
+    Timer timers[TIMER_COUNT];
+    int8_t slots[TIMER_WHEEL_SLOTS + 2 * TIMER_LEVEL_SLOTS];    // List heads
+    uint32_t tick;                  // Next tick to process
+
+    void insert(int8_t id);
+    void unlink(int8_t id);
+    void cascade(uint8_t level);
+};
+
+class EventLoop {
+public:
+    EventLoop();
+
+    int8_t after(uint32_t delay, TimerCallback callback) { return wheel.start(delay, 0, callback); }
+    int8_t every(uint32_t period, TimerCallback callback, uint32_t delay = 0) {
+        return wheel.start(delay, period, callback);
+    }
+    void cancel(int8_t& id) { wheel.cancel(id); }
+    bool active(int8_t id) const { return wheel.active(id); }
+
+    void on(uint8_t type, EventHandler handler) { handlers[type] = handler; }
+
+    /**
+     * Queues an event, safe to call from an interrupt.
+     * @return false if the queue is full, the event is dropped.
+     */
+    bool post(uint8_t type, uint32_t data = 0);
+
+    // Dispatches the queued events, then runs the due timers
+    void run();
+
+    // [ms] until run() has something to do, 0 if events are queued
+    uint32_t idleTime() const { return tail != head ? 0 : wheel.idleTime(millis()); }
+
+    uint32_t dropped() const { return droppedEvents; }
+
+private:
+    struct Event {
+        uint8_t type;
+        uint32_t data;
+        uint32_t time;
+    };
+
+    TimerWheel wheel;
+    EventHandler handlers[EVENT_TYPE_COUNT];
+    Event queue[EVENT_QUEUE_SIZE];
+    volatile uint8_t head = 0;      // Written by post() only
+    volatile uint8_t tail = 0;      // Written by run() only
+    volatile uint32_t droppedEvents = 0;
+};
+
+extern EventLoop eventLoop;
+
+#endif  // eventLoop.h
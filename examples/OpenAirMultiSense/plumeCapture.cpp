@@ -0,0 +1,185 @@
+#include "plumeCapture.h"
+#include "sensorDrivers.h"
+
+#define VALUES_OFFSET   offsetof(SensorPayload, sps30Data)
+
+PlumeCapture plumeCapture;
+
+// The record's sensor values as one uint16 array (the struct is packed)
+static uint16_t getValue(const SensorPayload& record, uint8_t i) {
+    uint16_t value;
+    memcpy(&value, (const uint8_t*)&record + VALUES_OFFSET + 2 * i, sizeof(value));
+    return value;
+}
+
+static void setValue(SensorPayload& record, uint8_t i, uint16_t value) {
+    memcpy((uint8_t*)&record + VALUES_OFFSET + 2 * i, &value, sizeof(value));
+}
+
+bool PlumeDetector::update(const SensorPayload& record) {
+    const SensorData* data[] = {&record.sps30Data, &record.pmsa003iData, &record.cubicPm2012, &record.cubicPm2016};
+    bool plume = false;
+    for (uint8_t slot = 0; slot < PLUME_CHANNELS / 2; slot++) {
+        uint16_t values[] = {data[slot]->concentration, data[slot]->particles};
+        for (uint8_t signal = PLUME_PM25; signal <= PLUME_PARTICLES; signal++) {
+            // Every channel is updated, the first one that shows the plume is reported
+            if (updateChannel(channels[2 * slot + signal], values[signal], signal) && !plume) {
+                plume = true;
+                triggerSlot = slot;
+                triggerSignal = signal;
+                triggerValue = values[signal];
+            }
+        }
+    }
+    return plume;
+}
+
+void PlumeDetector::reset() {
+    for (uint8_t i = 0; i < PLUME_CHANNELS; i++) channels[i] = Channel();
+}
+
+bool PlumeDetector::updateChannel(Channel& channel, uint16_t value, uint8_t signal) {
+    if (value == SENSOR_VALUE_INVALID) {
+        channel.recentCount = 0;        // No slope across a gap
+        return false;
+    }
+
+    bool plume = false;
+    if (channel.baseline < 0) {
+        channel.baseline = (int32_t)value * 16;
+    } else {
+        int32_t base = channel.baseline / 16;
+        if (signal == PLUME_PM25) {
+            plume = value > base + PLUME_PM25_RISE;
+            // Full history: the oldest value is the next one overwritten
+            if (channel.recentCount == PLUME_SLOPE_RECORDS) {
+                plume |= value > channel.recent[channel.recentHead] + PLUME_PM25_SLOPE;
+            }
+        } else {
+            plume = value > base + PLUME_COUNT_MIN_RISE &&
+                    (uint32_t)value * 100 > (uint32_t)base * (100 + PLUME_COUNT_RISE_PCT);
+        }
+        channel.baseline += ((int32_t)value * 16 - channel.baseline) / PLUME_BASELINE_RECORDS;
+    }
+
+    channel.recent[channel.recentHead] = value;
+    channel.recentHead = (channel.recentHead + 1) % PLUME_SLOPE_RECORDS;
+    if (channel.recentCount < PLUME_SLOPE_RECORDS) channel.recentCount++;
+    return plume;
+}
+
+void PlumeCapture::feed(const SensorPayload& record) {
+    bool plume = detector.update(record);
+    if (requested || plume) {
+        if (recording()) {
+            postLeft = CAPTURE_POST_RECORDS + 1;    // Still going on, extend
+        } else if (requested) {
+            startCapture(record, CAPTURE_SOURCE_REQUEST, PLUME_REQUEST, 0);
+        } else {
+            startCapture(record, detector.slot(), detector.signal(), detector.value());
+        }
+        requested = false;
+    }
+
+    if (recording()) {
+        storeRecord(record);
+        lastRecorded = record;
+        if (--postLeft == 0) {
+            logCaptureEvent(record, false, 0, record.counter, 0, 0);
+        }
+        return;
+    }
+
+    // Waiting: the oldest record leaves the window into the summary
+    if (count == CAPTURE_PRE_RECORDS) {
+        summarize(window[head]);
+    } else {
+        count++;
+    }
+    window[head] = record;
+    head = (head + 1) % CAPTURE_PRE_RECORDS;
+}
+
+void PlumeCapture::flush() {
+    if (recording()) {
+        // The window is empty while recording, only the end marker is missing
+        logCaptureEvent(lastRecorded, false, 0, lastRecorded.counter, 0, 0);
+        postLeft = 0;
+    }
+    if (summarized > 0) writeSummary();
+    uint8_t oldest = (head + CAPTURE_PRE_RECORDS - count) % CAPTURE_PRE_RECORDS;
+    for (uint8_t i = 0; i < count; i++) {
+        storeRecord(window[(oldest + i) % CAPTURE_PRE_RECORDS]);
+    }
+    head = 0;
+    count = 0;
+}
+
+void PlumeCapture::reset() {
+    head = 0;
+    count = 0;
+    postLeft = 0;
+    summarized = 0;
+    requested = false;
+    detector.reset();
+}
+
+void PlumeCapture::summarize(const SensorPayload& record) {
+    if (summarized == 0) {
+        for (uint8_t i = 0; i < CAPTURE_VALUE_COUNT; i++) {
+            sums[i] = 0;
+            sumCounts[i] = 0;
+        }
+    }
+    for (uint8_t i = 0; i < CAPTURE_VALUE_COUNT; i++) {
+        uint16_t value = getValue(record, i);
+        if (value != SENSOR_VALUE_INVALID) {
+            sums[i] += value;
+            sumCounts[i]++;
+        }
+    }
+    summaryLast = record;
+    if (++summarized == CAPTURE_SUMMARY_RECORDS) writeSummary();
+}
+
+void PlumeCapture::writeSummary() {
+    // Counter and timestamp of the newest record in it, so the file stays in order
+    SensorPayload summary = summaryLast;
+    for (uint8_t i = 0; i < CAPTURE_VALUE_COUNT; i++) {
+        setValue(summary, i, sumCounts[i] ? (sums[i] + sumCounts[i] / 2) / sumCounts[i] : SENSOR_VALUE_INVALID);
+    }
+    storeRecord(summary);
+    summarized = 0;
+}
+
+void PlumeCapture::startCapture(const SensorPayload& record, uint8_t source, uint8_t signal, uint16_t value) {
+    // What is older than the window goes first, as a (partial) summary
+    if (summarized > 0) writeSummary();
+
+    uint8_t oldest = (head + CAPTURE_PRE_RECORDS - count) % CAPTURE_PRE_RECORDS;
+    uint32_t first = count > 0 ? window[oldest].counter : record.counter;
+    logCaptureEvent(record, true, source, first, signal, value);
+    flush();
+    captureCount++;
+    postLeft = CAPTURE_POST_RECORDS + 1;    // This record and the following ones
+}
+
+void PlumeCapture::logCaptureEvent(const SensorPayload& record, bool start, uint8_t source, uint32_t first,
+                                   uint8_t signal, uint16_t value) {
+    EventRecord event;
+    event.counter = record.counter;
+    event.timestamp = record.timestamp;
+    event.type = EVENT_CAPTURE;
+    event.source = source;
+    event.data[0] = start;
+    event.data[1] = first;
+    event.data[2] = signal;
+    event.data[3] = value;
+    if (start) {
+        Serial.printf("[+] Capture from record #%lu (source %u, signal %u, value %u)\n", (unsigned long)first, source,
+                      signal, value);
+    } else {
+        Serial.printf("[+] Capture ended at record #%lu\n", (unsigned long)first);
+    }
+    storeEvent(event);
+}
@@ -0,0 +1,126 @@
+#ifndef plumeCapture_h
+#define plumeCapture_h
+
+#include "OpenAirMultiSense.h"
+
+// Plume-triggered capture: instead of logging every record, the logger keeps
+// the last CAPTURE_PRE_RECORDS records in RAM and writes one summary record
+// (the mean of every value) per CAPTURE_SUMMARY_RECORDS records that leave
+// that window. When a plume is detected on any sensor, or a capture is
+// requested (button, "capture now"), the whole window is written at full
+// resolution, followed by every record until CAPTURE_POST_RECORDS records
+// after the last trigger. Summaries are only written for records that fell
+// out of the window, so the session file stays in counter order.
+// Detector, per sensor and per record:
+//  - PM2.5 more than PLUME_PM25_RISE above its baseline (slow moving average)
+//  - PM2.5 up by PLUME_PM25_SLOPE within PLUME_SLOPE_RECORDS records
+//  - particle count more than PLUME_COUNT_RISE_PCT (and PLUME_COUNT_MIN_RISE)
+//    above its baseline
+// SENSOR_VALUE_INVALID readings (sensor off, warming up, failed) are skipped.
+#define CAPTURE_PRE_RECORDS     60      // Pre-trigger window, 1 min at READ_INTERVAL
+#define CAPTURE_POST_RECORDS    120     // After the last trigger
+#define CAPTURE_SUMMARY_RECORDS 10      // Averaged into one record outside captures
+#define PLUME_BASELINE_RECORDS  64      // Time constant of the baseline
+#define PLUME_SLOPE_RECORDS     5
+#define PLUME_PM25_RISE         15      // [ug/m3]
+#define PLUME_PM25_SLOPE        10      // [ug/m3]
+#define PLUME_COUNT_RISE_PCT    50      // [%]
+#define PLUME_COUNT_MIN_RISE    20      // Counts near zero are noisy
+#define PLUME_CHANNELS          8       // PM2.5 and particles of the 4 sensor slots
+
+#define CAPTURE_VALUE_COUNT     9       // uint16 values of a SensorPayload
+
+// EVENT_CAPTURE source of a requested capture (others: sensor slot)
+#define CAPTURE_SOURCE_REQUEST  0xFF
+
+enum plumeSignals {
+    PLUME_PM25 = 0,
+    PLUME_PARTICLES,
+    PLUME_REQUEST
+};
+
+/**
+ * Implemented by the application (logger task): appends to the open session.
+ */
+void storeRecord(const SensorPayload& record);
+void storeEvent(const EventRecord& event);
+
+class PlumeDetector {
+public:
+    /**
+     * Feeds one record.
+     * @return true if it shows a plume, see slot() / signal() / value().
+     */
+    bool update(const SensorPayload& record);
+
+    void reset();
+
+    uint8_t slot() const { return triggerSlot; }
+    uint8_t signal() const { return triggerSignal; }
+    uint16_t value() const { return triggerValue; }
+
+private:
+    struct Channel {
+        int32_t baseline = -1;              // x16, -1: no reading yet
+        uint16_t recent[PLUME_SLOPE_RECORDS];
+        uint8_t recentCount = 0;
+        uint8_t recentHead = 0;
+    };
+
+    Channel channels[PLUME_CHANNELS];
+    uint8_t triggerSlot = 0;
+    uint8_t triggerSignal = 0;
+    uint16_t triggerValue = 0;
+
+    bool updateChannel(Channel& channel, uint16_t value, uint8_t signal);
+};
+
+class PlumeCapture {
+public:
+    bool enabled = false;
+
+    /**
+     * Logger task: takes one record, writes what the capture state calls for.
+     */
+    void feed(const SensorPayload& record);
+
+    // Captures from the next record on, e.g. on a button press. Any task.
+    void request() { requested = true; }
+
+    // Writes what is held back (summary, window) in order and ends a running
+    // capture with its end event, e.g. before the session ends
+    void flush();
+
+    // Forgets the window and the detector state, for a new session
+    void reset();
+
+    bool recording() const { return postLeft > 0; }
+    uint8_t buffered() const { return count; }
+    uint32_t captures() const { return captureCount; }
+
+private:
+    SensorPayload window[CAPTURE_PRE_RECORDS];
+    uint8_t head = 0;                   // Next slot to write
+    uint8_t count = 0;
+    uint16_t postLeft = 0;              // Records still written in full
+    SensorPayload lastRecorded;         // Newest record written in full, for the end event
+    uint32_t captureCount = 0;
+    volatile bool requested = false;
+    PlumeDetector detector;
+
+    // Summary of the records that left the window
+    uint32_t sums[CAPTURE_VALUE_COUNT];
+    uint8_t sumCounts[CAPTURE_VALUE_COUNT];
+    uint8_t summarized = 0;
+    SensorPayload summaryLast;          // Counter and timestamp of the summary
+
+    void summarize(const SensorPayload& record);
+    void writeSummary();
+    void startCapture(const SensorPayload& record, uint8_t source, uint8_t signal, uint16_t value);
+    void logCaptureEvent(const SensorPayload& record, bool start, uint8_t source, uint32_t first,
+                         uint8_t signal, uint16_t value);
+};
+
+extern PlumeCapture plumeCapture;
+
+#endif  // plumeCapture.h
@@ -0,0 +1,119 @@
+#include "powerManager.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+
+PowerManager powerManager;
+
+const uint32_t PowerManager::current[POWER_STATE_COUNT] = {CURRENT_ACTIVE_UA, CURRENT_IDLE_UA, CURRENT_SLEEP_UA};
+
+static const char* stateNames[POWER_STATE_COUNT] = {"active", "idle", "sleep"};
+
+PowerManager::PowerManager() {
+    for (uint8_t i = 0; i < POWER_STATE_COUNT; i++) time[i] = 0;
+    for (uint8_t i = 0; i < WAKE_SOURCE_COUNT; i++) wakeups[i] = 0;
+}
+
+void PowerManager::begin(uint8_t wakePin) {
+    this->wakePin = wakePin;
+    since = esp_timer_get_time();
+    state = POWER_IDLE;
+    setCpuFrequencyMhz(POWER_IDLE_MHZ);
+}
+
+void PowerManager::holdAwake(uint8_t sensor, bool enable) {
+    if (enable) {
+        awakeSensors |= 1 << sensor;
+    } else {
+        awakeSensors &= ~(1 << sensor);
+    }
+}
+
+void PowerManager::enter(uint8_t next) {
+    account(next);
+    setCpuFrequencyMhz(next == POWER_ACTIVE ? POWER_ACTIVE_MHZ : POWER_IDLE_MHZ);
+}
+
+void PowerManager::sampleStarted(int32_t lateness) {
+    if (lateness < 0) lateness = 0;
+    if ((uint32_t)lateness > maxLateness) maxLateness = lateness;
+    if ((uint32_t)lateness > maxLatenessEver) maxLatenessEver = lateness;
+    // Woken too late: wake up earlier from now on
+    if (slept && lateness > SAMPLE_JITTER_BOUND) {
+        guard = min(guard + lateness - SAMPLE_JITTER_BOUND, (uint32_t)SLEEP_GUARD_MAX);
+    }
+    slept = false;
+}
+
+bool PowerManager::idle(uint32_t idleTime, bool allowed) {
+    if (idleTime == 0) return false;
+    if (!allowed || idleTime < SLEEP_MIN_TIME + guard || awakeSensors != 0 || state == POWER_ACTIVE) {
+        vTaskDelay(1);                  // The idle task halts the CPU until the next interrupt
+        return false;
+    }
+
+    // The acquisition task can't start a sample between the check and the sleep
+    vTaskSuspendAll();
+    bool sleep = state != POWER_ACTIVE;
+    if (sleep) {
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+        esp_sleep_enable_timer_wakeup((uint64_t)(idleTime - guard) * 1000);
+        // Level wake-up on the button; its interrupt is off meanwhile, it would fire until restored
+        gpio_intr_disable((gpio_num_t)wakePin);
+        gpio_wakeup_enable((gpio_num_t)wakePin, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+
+        account(POWER_SLEEP);
+        esp_light_sleep_start();
+        account(POWER_IDLE);
+
+        gpio_wakeup_disable((gpio_num_t)wakePin);
+        gpio_set_intr_type((gpio_num_t)wakePin, GPIO_INTR_ANYEDGE);
+        gpio_intr_enable((gpio_num_t)wakePin);
+
+        wakeSource = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO ? WAKE_GPIO : WAKE_TIMER;
+        wakeups[wakeSource]++;
+        slept = true;
+    }
+    xTaskResumeAll();
+    return sleep;
+}
+
+uint64_t PowerManager::stateTime(uint8_t s) {
+    portENTER_CRITICAL(&lock);
+    uint64_t t = time[s];
+    if (s == state) t += esp_timer_get_time() - since;
+    portEXIT_CRITICAL(&lock);
+    return t;
+}
+
+uint64_t PowerManager::charge() {
+    // us * uA -> nAh
+    uint64_t sum = 0;
+    for (uint8_t s = 0; s < POWER_STATE_COUNT; s++) sum += stateTime(s) * current[s];
+    return sum / 3600000ULL;
+}
+
+uint32_t PowerManager::takeMaxLateness() {
+    uint32_t lateness = maxLateness;
+    maxLateness = 0;
+    return lateness;
+}
+
+void PowerManager::printStatus() {
+    for (uint8_t s = 0; s < POWER_STATE_COUNT; s++) {
+        Serial.printf("POWER %s %llu\n", stateNames[s], stateTime(s) / 1000);
+    }
+    Serial.printf("POWER charge %llu\n", charge() / 1000);
+    Serial.printf("POWER wakeups %lu %lu\n", (unsigned long)wakeups[WAKE_TIMER], (unsigned long)wakeups[WAKE_GPIO]);
+    Serial.printf("POWER jitter %lu %lu\n", (unsigned long)maxLatenessEver, (unsigned long)guard);
+}
+
+void PowerManager::account(uint8_t next) {
+    portENTER_CRITICAL(&lock);
+    int64_t now = esp_timer_get_time();
+    time[state] += now - since;
+    since = now;
+    state = next;
+    portEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,115 @@
+#ifndef powerManager_h
+#define powerManager_h
+
+#include <Arduino.h>
+
+// Power-managed idle: between sampling deadlines loop() calls idle() and the
+// chip goes into light sleep until shortly before the next deadline. It wakes
+// on the timer or the button (GPIO). A UART sensor that pushes frames on its
+// own (Plantower active mode) keeps the chip awake: waking on its RX loses the
+// frame, and it would be gone again before the next one. The CPU runs at
+// POWER_ACTIVE_MHZ while the acquisition task samples and at POWER_IDLE_MHZ
+// otherwise.
+// Light sleep needs the USB host to be gone: the USB Serial/JTAG port stops
+// in sleep, so with a host connected the chip only idles at the lower clock.
+// Energy is estimated in software from the time spent in each power state
+// and the typical current of that state (ESP32-C3 datasheet, radio off,
+// sensors and display not included).
+#define POWER_ACTIVE_MHZ        160
+#define POWER_IDLE_MHZ          80      // Lowest clock with the 80 MHz APB: UART and I2C timing unchanged
+#define SLEEP_MIN_TIME          10      // [ms] shorter idle periods are spent awake
+#define SLEEP_GUARD             2       // [ms] woken this long before the deadline, raised when samples start late
+#define SLEEP_GUARD_MAX         20      // [ms]
+#define SAMPLE_JITTER_BOUND     5       // [ms] allowed lateness of a sample start after a sleep
+
+#define CURRENT_ACTIVE_UA       23000   // [uA] 160 MHz
+#define CURRENT_IDLE_UA         13000   // [uA] 80 MHz, waiting for interrupts
+#define CURRENT_SLEEP_UA        130     // [uA] light sleep
+
+enum powerStates {
+    POWER_ACTIVE = 0,                   // Acquisition running
+    POWER_IDLE,                         // Awake, loop() and the consumers
+    POWER_SLEEP,
+    POWER_STATE_COUNT
+};
+
+enum wakeSources {
+    WAKE_TIMER = 0,
+    WAKE_GPIO,
+    WAKE_SOURCE_COUNT
+};
+
+class PowerManager {
+public:
+    PowerManager();
+
+    /**
+     * Starts the energy accounting in POWER_IDLE.
+     * @param wakePin: Active-low button that wakes the chip, its CHANGE interrupt is kept.
+     */
+    void begin(uint8_t wakePin);
+
+    /**
+     * Keeps the chip out of light sleep while a UART sensor sends without
+     * being asked, its frames would be lost in sleep.
+     * @param sensor: uartSensors id, see uartPorts.h.
+     */
+    void holdAwake(uint8_t sensor, bool enable);
+
+    // Acquisition task: POWER_ACTIVE around a sample, POWER_IDLE after it
+    void enter(uint8_t state);
+
+    /**
+     * Acquisition task: reports how late a sample started. After a sleep a
+     * lateness above SAMPLE_JITTER_BOUND wakes the following sleeps earlier.
+     * @param lateness: [ms] after the scheduled time.
+     */
+    void sampleStarted(int32_t lateness);
+
+    /**
+     * Called by loop() when it has nothing to do: sleeps until the guard time
+     * before the next deadline if that is at least SLEEP_MIN_TIME away,
+     * otherwise waits for interrupts for a tick. Never sleeps while a sample
+     * is being taken or a UART sensor pushes frames.
+     * @param idleTime: [ms] until the next deadline.
+     * @param allowed: false keeps the chip awake (USB host, button held).
+     * @return true if the chip slept, see lastWake().
+     */
+    bool idle(uint32_t idleTime, bool allowed);
+
+    uint8_t lastWake() const { return wakeSource; }
+
+    // [us] in each state since begin(), including the current one
+    uint64_t stateTime(uint8_t state);
+
+    // [nAh] estimated since begin()
+    uint64_t charge();
+
+    // Largest sample lateness [ms] since the last call, then resets it
+    uint32_t takeMaxLateness();
+
+    // "POWER ..." lines for the "power" command
+    void printStatus();
+
+private:
+    static const uint32_t current[POWER_STATE_COUNT];
+
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    uint64_t time[POWER_STATE_COUNT];   // [us]
+    int64_t since = 0;                  // esp_timer_get_time() of the last state change
+    volatile uint8_t state = POWER_IDLE;
+    uint8_t wakePin = 0;
+    uint8_t awakeSensors = 0;           // Bit per UART sensor, see holdAwake()
+    uint8_t wakeSource = WAKE_TIMER;
+    uint32_t wakeups[WAKE_SOURCE_COUNT];
+    uint32_t guard = SLEEP_GUARD;       // [ms]
+    volatile bool slept = false;        // Since the last sample started
+    volatile uint32_t maxLateness = 0;  // [ms]
+    uint32_t maxLatenessEver = 0;
+
+    void account(uint8_t next);
+};
+
+extern PowerManager powerManager;
+
+#endif  // powerManager.h
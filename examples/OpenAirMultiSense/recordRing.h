@@ -0,0 +1,55 @@
+#ifndef recordRing_h
+#define recordRing_h
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * Lock-free single-producer / single-consumer ring: one task push()es, one
+ * other task pop()s, neither ever waits for the other. Each index is only
+ * written by its own side; the release/acquire pair makes sure the consumer
+ * sees a slot's contents before it sees the index that publishes it. A full
+ * ring drops the new item and counts it in overflows(), so a consumer that
+ * falls behind never stalls the producer.
+ * @param T: Item type, copied in and out.
+ * @param Size: Slots (power of 2), holds Size - 1 items.
+ */
+template <typename T, uint8_t Size>
+class RecordRing {
+public:
+    bool push(const T& item) {
+        uint8_t head = _head.load(std::memory_order_relaxed);
+        uint8_t next = (head + 1) & (Size - 1);
+        if (next == _tail.load(std::memory_order_acquire)) {
+            _overflows++;
+            return false;
+        }
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        uint8_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) return false;
+        item = _items[tail];
+        _tail.store((tail + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    uint8_t count() const {
+        return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire)) & (Size - 1);
+    }
+
+    uint32_t overflows() const { return _overflows; }
+
+private:
+    static_assert((Size & (Size - 1)) == 0, "RecordRing size must be a power of 2");
+
+    T _items[Size];
+    std::atomic<uint8_t> _head{0};      // Written by the producer only
+    std::atomic<uint8_t> _tail{0};      // Written by the consumer only
+    volatile uint32_t _overflows = 0;   // Producer side
+};
+
+#endif  // recordRing.h
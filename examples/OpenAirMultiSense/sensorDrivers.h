@@ -0,0 +1,534 @@
+#ifndef sensorDrivers_h
+#define sensorDrivers_h
+
+#include "OpenAirMultiSense.h"
+#include "uartPorts.h"
+#include "sensorHealth.h"
+#include "powerManager.h"
+#include "dutyCycle.h"
+
+#define SENSOR_VALUE_INVALID    0xFFFF  // Logged when a reading failed or the sensor isn't fitted
+
+// [ms] after the duty cycle switched the PM2012 on until its readings are used.
+// Cubic gives no figure, this is the Plantower one; set it for the build.
+#ifndef PM2012_WARMUP
+#define PM2012_WARMUP           30000
+#endif
+
+// Sensor drivers: thin adapters over the sensor libraries, all with the same
+// (non-virtual) interface
+//   slot            : index of the sensor in 'sensors' (timing, display, events)
+//   timeout_ms      : default (longest) read timeout
+//   name()          : for debug messages
+//   begin()         : power up and configure, false if the sensor didn't answer
+//   setTimeout(ms)  : timeout for the following reads
+//   startRead()     : start a measurement (request/response sensors)
+//   poll()          : collect it, returns a readStatus
+//   result(payload) : write the last reading into the record
+//   printStatus()   : driver specific debug output
+//   pushes()        : the sensor sends frames on its own, the timeout isn't adapted
+//   buffered()      : the last poll() found its answer already received
+//   switchable      : fan and laser can be switched off by the duty cycle
+//   warmup_ms       : [ms] after powerUp() until readings are stable
+//   powerDown()     : fan and laser off
+//   powerUp()       : fan and laser on
+// The active sensors are a compile-time list, SensorSet<DriverA, DriverB, ...>,
+// which expands into the acquisition sequence with every call resolved at
+// compile time. Drivers that aren't listed are never instantiated and cost
+// no flash or RAM. Every listed driver has a SensorHealth (sensorHealth.h):
+// failing sensors are isolated and re-probed, health changes are reported to
+// logHealthEvent(). Switchable sensors follow the DutyCycle (dutyCycle.h),
+// they are only read once warmed up; switches are reported to logPowerEvent().
+
+struct SensorDriver {
+    static const uint16_t timeout_ms = 1000;
+    void setTimeout(uint16_t) {}    // I2C sensors: the bus has its own timeout
+    void startRead() {}             // Most sensors stream or answer a single read call
+    void printStatus() {}           // Driver specific debug output
+    bool pushes() const { return false; }
+    bool buffered() const { return false; }
+    static const bool switchable = false;
+    static const uint32_t warmup_ms = 0;
+    void powerDown() {}
+    void powerUp() {}
+};
+
+/**
+ * Implemented by the application: records a sensor's health change.
+ * @param slot: Sensor slot of the driver.
+ */
+void logHealthEvent(uint8_t slot, const char* name, const SensorHealth& health);
+
+/**
+ * Implemented by the application: records a sensor's fan and laser being switched.
+ * @param slot: Sensor slot of the driver.
+ * @param warmup: [ms] until the readings are used again, when switched on.
+ */
+void logPowerEvent(uint8_t slot, const char* name, bool on, uint32_t warmup);
+
+/**
+ * Plantower PMS5003 / PMS7003 on a UART, stored in the PMSA003I slot. In
+ * active mode the sensor pushes a frame about every second, poll() drains
+ * the RX buffer and keeps the newest good frame, so frames queued while the
+ * loop was busy don't add lag. In passive mode the read is requested in
+ * startRead() and only that answer is taken. A sensor that shares its port
+ * is always run passive, its request is then sent in poll().
+ * An active-mode sensor keeps the chip out of light sleep, battery builds
+ * run it Passive.
+ * @param Uart: UART_PMS5003 or UART_PMS7003, its route in uartPorts.
+ * @param Passive: request every reading instead of using active mode.
+ */
+template <uint8_t Uart, bool Passive = false>
+class PmsDriver : public SensorDriver {
+public:
+    static const uint8_t slot = PMSA003I;
+
+    const char* name() const { return uartPorts.route(Uart).name; }
+
+    bool begin() {
+        uartPorts.attach(Uart);
+        uartPorts.acquire(Uart);
+        pms.begin(uartPorts.port(Uart));
+        setMode();
+        pms.wakeUp();                   // Waking up, wait for stable readings
+        delay(100);                     // Delay wake up time
+        return true;
+    }
+
+    static const uint16_t timeout_ms = PMS::SINGLE_RESPONSE_TIME;
+    void setTimeout(uint16_t ms) { timeout = ms; }
+
+    void startRead() {
+        requested = false;
+        if (!passive || uartPorts.shared(Uart)) return;
+        if (uartPorts.acquire(Uart)) pms.begin(uartPorts.port(Uart));
+        pms.requestRead();
+        requested = true;
+    }
+
+    uint8_t poll() {
+        // A port switch since startRead() flushed the answer
+        if (uartPorts.acquire(Uart)) {
+            pms.begin(uartPorts.port(Uart));
+            requested = false;
+        }
+        if (mode() != passive) {        // Remapped at runtime
+            setMode();
+            requested = false;
+        }
+        if (passive && !requested) pms.requestRead();
+        requested = false;
+
+        uint32_t checksumErrors = pms.checksumErrors();
+        bool ok = passive ? pms.readUntil(data, timeout) : pms.readLatest(data, timeout);
+        if (ok) return READ_OK;
+        return pms.checksumErrors() != checksumErrors ? READ_CHECKSUM : READ_TIMEOUT;
+    }
+
+    void result(SensorPayload& payload) const {
+        payload.pmsa003iData.particles = data.PM_PC_0_3;
+        payload.pmsa003iData.concentration = data.PM_AE_UG_2_5;
+    }
+
+    void printStatus() {
+        Serial.printf("%s: %s mode, data age %lu ms, %u older frames dropped\n", name(),
+                      passive ? "passive" : "active", (unsigned long)pms.age(), pms.supersededFrames());
+    }
+
+    // Active mode: a read waits for the next frame, up to a frame interval
+    bool pushes() const { return !passive; }
+    bool buffered() const { return !passive && pms.wasBuffered(); }
+
+    static const bool switchable = true;
+    static const uint32_t warmup_ms = PMS::STEADY_RESPONSE_TIME;
+
+    void powerDown() {
+        if (uartPorts.acquire(Uart)) pms.begin(uartPorts.port(Uart));
+        pms.sleep();
+    }
+
+    void powerUp() {
+        if (uartPorts.acquire(Uart)) pms.begin(uartPorts.port(Uart));
+        pms.wakeUp();
+        setMode();
+    }
+
+private:
+    PMS pms;
+    PMS::DATA data;
+    bool passive = false;
+    bool requested = false;             // Read requested in startRead()
+    uint16_t timeout = timeout_ms;
+
+    bool mode() const { return Passive || uartPorts.shared(Uart); }
+
+    void setMode() {
+        passive = mode();
+        if (passive) {
+            pms.passiveMode();
+        } else {
+            pms.activeMode();
+        }
+        powerManager.holdAwake(Uart, !passive);
+    }
+};
+
+// Plantower PMSA003I over I2C (Adafruit library)
+class Pmsa003iDriver : public SensorDriver {
+public:
+    static const uint8_t slot = PMSA003I;
+
+    const char* name() const { return "PMSA003"; }
+
+    bool begin() {
+        // Driven here and not in setup(): without a PMSA003I the PMS7003 uses these pins
+        pinMode(PMSA003I_SET_PIN, OUTPUT);
+        pinMode(PMSA003I_RESET_PIN, OUTPUT);
+        digitalWrite(PMSA003I_SET_PIN, HIGH);   // Set to HIGH to enable I2C mode
+        digitalWrite(PMSA003I_RESET_PIN, HIGH); // Keep the sensor out of reset
+        if (!sensor.begin_I2C()) {      // connect to the sensor over I2C
+            Serial.println("Could not find PM 2.5 sensor!");
+            return false;
+        }
+        Serial.println("PMSA003I found!");
+        return true;
+    }
+
+    uint8_t poll() { return sensor.read(&data) ? READ_OK : READ_FAILED; }
+
+    void result(SensorPayload& payload) const {
+        payload.pmsa003iData.particles = data.particles_03um;
+        payload.pmsa003iData.concentration = data.pm25_env;
+    }
+
+    // SET pin low: sleep, fan and laser off
+    static const bool switchable = true;
+    static const uint32_t warmup_ms = 30000;    // Datasheet: stable 30 s after wake-up (fan)
+    void powerDown() { digitalWrite(PMSA003I_SET_PIN, LOW); }
+    void powerUp() { digitalWrite(PMSA003I_SET_PIN, HIGH); }
+
+private:
+    Adafruit_PM25AQI sensor;
+    PM25_AQI_Data data;
+};
+
+// Cubic PM2012 on a UART (request/response, 9600 baud), routed by uartPorts
+class Pm2012Driver : public SensorDriver {
+public:
+    static const uint8_t slot = PM2012;
+
+    const char* name() const { return "PM2012"; }
+
+    bool begin() {
+        uartPorts.attach(UART_PM2012);
+        uartPorts.acquire(UART_PM2012);
+        uartPorts.drain(UART_PM2012);   // Probe: the port may hold the tail of a late reply
+        sensor.begin(uartPorts.port(UART_PM2012));
+        Serial.println("Cubic PM UART sensor initialize.");
+        return true;
+    }
+
+    void setTimeout(uint16_t ms) { timeout = ms; }
+
+    uint8_t poll() {
+        uartPorts.acquire(UART_PM2012);
+        uartPorts.port(UART_PM2012).setTimeout(timeout);    // The port may be shared
+        if (sensor.readMeasurement(data)) return READ_OK;
+        switch (sensor.lastError()) {
+            case CUBIC_ERR_TIMEOUT:  return READ_TIMEOUT;
+            case CUBIC_ERR_CHECKSUM: return READ_CHECKSUM;
+            default:                 return READ_FAILED;
+        }
+    }
+
+    void result(SensorPayload& payload) const {
+        payload.cubicPm2012.particles = data.count_0_3;
+        payload.cubicPm2012.concentration = data.pm2_5_grimm;
+        payload.cubicPm2012Tsi = data.pm2_5_tsi;
+    }
+
+    static const bool switchable = true;
+    static const uint32_t warmup_ms = PM2012_WARMUP;
+    void powerDown() {
+        uartPorts.acquire(UART_PM2012);
+        uartPorts.port(UART_PM2012).setTimeout(timeout_ms);
+        sensor.closeFanAndLaser();
+    }
+    void powerUp() {
+        uartPorts.acquire(UART_PM2012);
+        uartPorts.port(UART_PM2012).setTimeout(timeout_ms);
+        sensor.openFanAndLaser();
+    }
+
+private:
+    Cubic_PMsensor_UART sensor;
+    PMData data;
+    uint16_t timeout = timeout_ms;
+};
+
+/**
+ * Cubic PM2016 over I2C (cubicPmI2c). The bus transfer happens in
+ * startRead(), poll() only checks and parses the frame.
+ * @param ShortRead: only transfer the bytes that are logged, without the
+ *                   checksum (21 instead of 32 bytes on the bus).
+ */
+template <bool ShortRead = false>
+class Pm2016Driver : public SensorDriver {
+public:
+    static const uint8_t slot = PM2016;
+
+    const char* name() const { return "PM2016"; }
+
+    bool begin() {
+        sensor.setShortRead(ShortRead);
+        return sensor.begin();
+    }
+
+    void startRead() { sensor.requestMeasurement(); }
+
+    uint8_t poll() {
+        if (sensor.readMeasurement(data)) return READ_OK;
+        switch (sensor.lastError()) {
+            case CUBIC_ERR_TIMEOUT:  return READ_TIMEOUT;
+            case CUBIC_ERR_CHECKSUM: return READ_CHECKSUM;
+            default:                 return READ_FAILED;
+        }
+    }
+
+    void result(SensorPayload& payload) const {
+        payload.cubicPm2016.particles = data.count_0_3;
+        payload.cubicPm2016.concentration = data.pm2_5_grimm;
+    }
+
+private:
+    Cubic_PMsensor_I2C sensor;
+    PMData data;
+};
+
+/**
+ * Sensirion SPS30 on a UART (SHDLC, 115200 baud, sps30Shdlc), routed by
+ * uartPorts. The request goes out in startRead(), so the response arrives
+ * while the other sensors are read and poll() mostly just parses it.
+ * @param Format: SPS30_FORMAT_UINT16 or SPS30_FORMAT_FLOAT, what the sensor
+ *                sends. Float values are rounded for the record.
+ */
+template <uint8_t Format = SPS30_FORMAT_UINT16>
+class Sps30Driver : public SensorDriver {
+public:
+    static const uint8_t slot = SPS30;
+
+    const char* name() const { return "SPS30"; }
+
+    bool begin() {
+        uartPorts.attach(UART_SPS30);
+        uartPorts.acquire(UART_SPS30);
+
+        char serialNumber[32] = {0};
+        char productType[9] = {0};
+        bool ok = true;
+        sensor.begin(uartPorts.port(UART_SPS30));
+        sensor.stopMeasurement();
+        ok &= sensor.readDeviceInfo(SPS30_INFO_SERIAL_NUMBER, serialNumber, sizeof serialNumber);
+        ok &= sensor.readDeviceInfo(SPS30_INFO_PRODUCT_TYPE, productType, sizeof productType);
+        ok &= sensor.startMeasurement(Format);
+        if (!ok) {
+            Serial.printf("Error trying to execute sps30 sensor: error %u, state 0x%02x\n",
+                          sensor.lastError(), sensor.state());
+            return false;
+        }
+        Serial.printf("SPS30 serialNumber: %s\n", serialNumber);
+        Serial.printf("SPS30 productType: %s\n", productType);
+        return true;
+    }
+
+    static const uint16_t timeout_ms = SPS30_RESPONSE_TIME;
+    void setTimeout(uint16_t ms) { timeout = ms; }
+
+    void startRead() {
+        if (uartPorts.acquire(UART_SPS30)) sensor.begin(uartPorts.port(UART_SPS30));
+        sensor.requestMeasurement();
+    }
+
+    uint8_t poll() {
+        if (uartPorts.acquire(UART_SPS30)) {
+            // The port was switched to another sensor since startRead(), ask again
+            sensor.begin(uartPorts.port(UART_SPS30));
+            sensor.requestMeasurement();
+        }
+        if (sensor.waitResponse(timeout)) return sensor.readValues(data) ? READ_OK : READ_FAILED;
+        switch (sensor.lastError()) {
+            case SPS30_ERR_TIMEOUT:  return READ_TIMEOUT;
+            case SPS30_ERR_CHECKSUM: return READ_CHECKSUM;
+            case SPS30_ERR_NO_DATA:  return READ_NO_DATA;
+            default:                 return READ_FAILED;
+        }
+    }
+
+    void result(SensorPayload& payload) const {
+        payload.sps30Data.particles = data.nc0p5;
+        payload.sps30Data.concentration = data.mc2p5;
+    }
+
+    // Idle mode: fan and laser off, measurements stopped
+    static const bool switchable = true;
+    static const uint32_t warmup_ms = 8000;     // Datasheet start-up time
+    void powerDown() {
+        if (uartPorts.acquire(UART_SPS30)) sensor.begin(uartPorts.port(UART_SPS30));
+        sensor.stopMeasurement();
+    }
+    void powerUp() {
+        if (uartPorts.acquire(UART_SPS30)) sensor.begin(uartPorts.port(UART_SPS30));
+        sensor.startMeasurement(Format);
+    }
+
+private:
+    Sps30_SHDLC sensor;
+    Sps30Values data;
+    uint16_t timeout = timeout_ms;
+};
+
+/**
+ * Marks every sensor value of the record as invalid, the active drivers
+ * then fill in what they read.
+ */
+inline void clearReadings(SensorPayload& payload) {
+    payload.sps30Data.particles = payload.sps30Data.concentration = SENSOR_VALUE_INVALID;
+    payload.pmsa003iData.particles = payload.pmsa003iData.concentration = SENSOR_VALUE_INVALID;
+    payload.cubicPm2012.particles = payload.cubicPm2012.concentration = SENSOR_VALUE_INVALID;
+    payload.cubicPm2012Tsi = SENSOR_VALUE_INVALID;
+    payload.cubicPm2016.particles = payload.cubicPm2016.concentration = SENSOR_VALUE_INVALID;
+}
+
+// Compile-time list of the active drivers, one member per driver
+template <typename... Drivers>
+class SensorSet;
+
+template <>
+class SensorSet<> {
+public:
+    static const uint8_t count = 0;
+    void begin() {}
+    void startRead() {}
+    void collect(SensorPayload&, uint32_t*) {}
+    void updatePower(uint32_t, const DutyCycle&) {}
+    uint32_t untilSwitch(uint32_t, const DutyCycle&) const { return UINT32_MAX; }
+    void printHealth() {}
+    void printPower(uint32_t) {}
+    void printStatus() {}
+};
+
+template <typename Driver, typename... Others>
+class SensorSet<Driver, Others...> {
+public:
+    static const uint8_t count = 1 + SensorSet<Others...>::count;
+
+    void begin() {
+        driver.begin();
+        others.begin();
+    }
+
+    /**
+     * One acquisition: starts a measurement on every sensor, then collects
+     * them in list order into the record.
+     * @param payload: Record to fill, values of failed sensors stay invalid.
+     * @param time_taken: [us] collect time per sensor slot.
+     */
+    void read(SensorPayload& payload, uint32_t* time_taken) {
+        clearReadings(payload);
+        startRead();
+        collect(payload, time_taken);
+    }
+
+    void startRead() {
+        if (!health.isolated() && power.warm(millis())) driver.startRead();
+        others.startRead();
+    }
+
+    void collect(SensorPayload& payload, uint32_t* time_taken) {
+        uint32_t now = millis();
+        time_taken[Driver::slot] = 0;
+        // Off or warming up: not read, the record keeps SENSOR_VALUE_INVALID
+        if (power.warm(now) && (!health.isolated() || health.probeDue(now))) {
+            if (health.isolated()) {
+                // Probe: start over as after a power cycle
+                driver.begin();
+                driver.startRead();
+            }
+            driver.setTimeout(timeout());
+            uint32_t tStart_measure = micros();
+            uint8_t status = driver.poll();
+            time_taken[Driver::slot] = micros() - tStart_measure;
+            if (status == READ_OK) {
+                driver.result(payload);
+            } else if (status != READ_NO_DATA) {
+                Serial.printf("Could not read from %s\n", driver.name());
+            }
+            if (health.update(status, time_taken[Driver::slot], now, !driver.buffered())) {
+                logHealthEvent(Driver::slot, driver.name(), health);
+            }
+        }
+        others.collect(payload, time_taken);
+    }
+
+    /**
+     * Switches the fans and lasers to the duty cycle.
+     * @param now: millis() the acquisition is scheduled for.
+     */
+    void updatePower(uint32_t now, const DutyCycle& duty) {
+        if (Driver::switchable) {
+            // Cleared long before millis() - validFrom could wrap
+            if (power.warming && power.warm(now)) power.warming = false;
+            bool on = duty.powered(now, Driver::warmup_ms);
+            if (on != power.on) {
+                power.on = on;
+                if (on) {
+                    driver.powerUp();
+                    power.warming = true;
+                    power.validFrom = now + Driver::warmup_ms;
+                } else {
+                    driver.powerDown();
+                }
+                logPowerEvent(Driver::slot, driver.name(), on, Driver::warmup_ms);
+            }
+        }
+        others.updatePower(now, duty);
+    }
+
+    // [ms] until the duty cycle switches the next sensor
+    uint32_t untilSwitch(uint32_t now, const DutyCycle& duty) const {
+        uint32_t next = Driver::switchable ? duty.untilSwitch(now, Driver::warmup_ms) : UINT32_MAX;
+        return min(next, others.untilSwitch(now, duty));
+    }
+
+    // One "HEALTH <sensor> <state> <failures> <checksum errors> <latency us> <timeout ms>" line per driver
+    void printHealth() {
+        Serial.printf("HEALTH %s %s %u %lu %lu %u\n", driver.name(), health.isolated() ? "isolated" : "ok",
+                      health.failures, (unsigned long)health.checksumErrors, (unsigned long)health.latency, timeout());
+        others.printHealth();
+    }
+
+    // One "SENSOR <sensor> <off|warming|on> <ms until warm>" line per driver
+    void printPower(uint32_t now) {
+        uint32_t left = power.warm(now) || !power.on ? 0 : power.validFrom - now;
+        Serial.printf("SENSOR %s %s %lu\n", driver.name(), !power.on ? "off" : left ? "warming" : "on", (unsigned long)left);
+        others.printPower(now);
+    }
+
+    void printStatus() {
+        driver.printStatus();
+        others.printStatus();
+    }
+
+private:
+    Driver driver;
+    SensorHealth health;
+
+    // [ms] for the next read
+    uint16_t timeout() const {
+        return driver.pushes() ? Driver::timeout_ms : health.timeout(Driver::timeout_ms);
+    }
+    SensorPower power;
+    SensorSet<Others...> others;
+};
+
+#endif  // sensorDrivers.h
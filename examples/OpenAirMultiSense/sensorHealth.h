@@ -0,0 +1,107 @@
+#ifndef sensorHealth_h
+#define sensorHealth_h
+
+#include <Arduino.h>
+
+// Per-sensor health: a sensor that fails HEALTH_FAILURES_TO_ISOLATE reads in
+// a row is isolated, i.e. skipped, so its timeouts don't eat into the other
+// sensors' cycle. It is re-initialized and probed again after a backoff that
+// doubles with every failed probe. Read timeouts follow the observed response
+// time of good reads (smoothed latency + 4 x its deviation, as TCP does for
+// retransmits), clamped to [HEALTH_MIN_TIMEOUT, driver default]. Sensors that
+// push frames on their own keep the driver default: a read waits for their
+// next frame, not for an answer.
+#define HEALTH_FAILURES_TO_ISOLATE  3
+#define HEALTH_BACKOFF_MIN          2000    // [ms]
+#define HEALTH_BACKOFF_MAX          64000   // [ms]
+#define HEALTH_MIN_TIMEOUT          30      // [ms]
+#define HEALTH_TIMEOUT_MARGIN       20      // [ms] on top of the estimate
+#define HEALTH_LATENCY_SAMPLES      8       // Good reads before the timeout adapts
+
+// Outcome of a driver's poll()
+enum readStatus {
+    READ_OK = 0,
+    READ_TIMEOUT,       // No (complete) answer
+    READ_CHECKSUM,      // Answer with a bad checksum
+    READ_FAILED,        // Any other error
+    READ_NO_DATA        // Answered, but without a new measurement since the last read
+};
+
+enum healthState {
+    HEALTH_OK = 0,
+    HEALTH_ISOLATED
+};
+
+struct SensorHealth {
+    uint8_t state = HEALTH_OK;
+    uint16_t failures = 0;          // Consecutive failed reads
+    uint32_t checksumErrors = 0;    // Since boot
+    uint32_t goodReads = 0;
+    uint32_t latency = 0;           // [us] smoothed response time of good reads
+    uint32_t latencyDev = 0;        // [us] smoothed deviation
+    uint32_t backoff = 0;           // [ms] until the next probe
+    uint32_t nextProbe = 0;         // millis() of the next probe
+
+    bool isolated() const { return state == HEALTH_ISOLATED; }
+    bool probeDue(uint32_t now) const { return (int32_t)(now - nextProbe) >= 0; }
+
+    /**
+     * Read timeout to use next.
+     * @param limit: [ms] the driver's default timeout.
+     */
+    uint16_t timeout(uint16_t limit) const {
+        if (isolated() || goodReads < HEALTH_LATENCY_SAMPLES) return limit;
+        uint32_t estimate = (latency + 4 * latencyDev) / 1000 + HEALTH_TIMEOUT_MARGIN;
+        return constrain(estimate, (uint32_t)HEALTH_MIN_TIMEOUT, (uint32_t)limit);
+    }
+
+    /**
+     * Accounts one read.
+     * @param status: readStatus of the driver's poll().
+     * @param elapsed: [us] time the read took.
+     * @param timed: false if the answer was already buffered, 'elapsed' then
+     *               says nothing about the sensor's latency.
+     * @return true if the state changed (OK <-> ISOLATED).
+     */
+    bool update(uint8_t status, uint32_t elapsed, uint32_t now, bool timed = true) {
+        if (status == READ_CHECKSUM) checksumErrors++;
+
+        if (status == READ_OK || status == READ_NO_DATA) {
+            // A "no new data" answer is too short to say anything about the read latency
+            if (status == READ_OK && timed) {
+                // Jacobson/Karels: gains 1/8 for the latency, 1/4 for its deviation
+                if (goodReads++ == 0) {
+                    latency = elapsed;
+                    latencyDev = elapsed / 2;
+                } else {
+                    uint32_t error = elapsed > latency ? elapsed - latency : latency - elapsed;
+                    latencyDev += ((int32_t)error - (int32_t)latencyDev) / 4;
+                    latency += ((int32_t)elapsed - (int32_t)latency) / 8;
+                }
+            }
+            failures = 0;
+            backoff = 0;
+            if (state != HEALTH_OK) {
+                state = HEALTH_OK;
+                return true;
+            }
+            return false;
+        }
+
+        failures++;
+        if (state == HEALTH_ISOLATED) {
+            backoff = min((uint32_t)HEALTH_BACKOFF_MAX, backoff * 2);
+            nextProbe = now + backoff;
+            return false;
+        }
+        if (failures >= HEALTH_FAILURES_TO_ISOLATE) {
+            state = HEALTH_ISOLATED;
+            backoff = HEALTH_BACKOFF_MIN;
+            nextProbe = now + backoff;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif  // sensorHealth.h
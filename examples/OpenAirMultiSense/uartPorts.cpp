@@ -0,0 +1,88 @@
+#include "uartPorts.h"
+#include "OpenAirMultiSense.h"
+
+UartPortManager uartPorts;
+
+UartPortManager::UartPortManager()
+    : ports{&Serial0, &Serial1},
+      owner{UART_NO_OWNER, UART_NO_OWNER},
+      routes{
+          // name,    port, RX,         TX,         baud
+          {"SPS30",   0,    -1,         -1,         115200},
+          {"PM2012",  1,    UART2_RX,   UART2_TX,   9600},
+          {"PMS5003", 0,    PMS5003_RX, PMS5003_TX, 9600},
+          {"PMS7003", 1,    PMS7003_RX, PMS7003_TX, 9600},
+      },
+      active{false, false, false, false} {}
+
+void UartPortManager::attach(uint8_t sensor) {
+    active[sensor] = true;
+}
+
+bool UartPortManager::shared(uint8_t sensor) const {
+    for (uint8_t i = 0; i < UART_SENSOR_COUNT; i++) {
+        if (i != sensor && active[i] && routes[i].port == routes[sensor].port) return true;
+    }
+    return false;
+}
+
+bool UartPortManager::acquire(uint8_t sensor) {
+    const UartRoute& r = routes[sensor];
+    HardwareSerial& serial = *ports[r.port];
+    int8_t last = owner[r.port];
+    if (last == (int8_t)sensor) return false;
+
+    if (last == UART_NO_OWNER || routes[last].rxPin != r.rxPin || routes[last].txPin != r.txPin) {
+        // end() releases the old pins in the GPIO matrix, begin() routes the new ones
+        if (last != UART_NO_OWNER) serial.end();
+        serial.begin(r.baud, SERIAL_8N1, r.rxPin, r.txPin);
+    } else if (routes[last].baud != r.baud) {
+        serial.updateBaudRate(r.baud);
+    }
+    // Whatever arrived meanwhile belongs to the previous sensor or is switching noise
+    drain(sensor);
+
+    owner[r.port] = sensor;
+    switches++;
+    return true;
+}
+
+void UartPortManager::drain(uint8_t sensor) {
+    Stream& serial = port(sensor);
+    while (serial.available()) serial.read();
+}
+
+bool UartPortManager::remap(uint8_t sensor, uint8_t port, int8_t rxPin, int8_t txPin) {
+    if (port >= UART_PORT_COUNT) return false;
+
+    // Release the sensor's current port, both ports get configured from scratch
+    uint8_t old = routes[sensor].port;
+    if (owner[old] == (int8_t)sensor) {
+        ports[old]->end();
+        owner[old] = UART_NO_OWNER;
+    }
+    routes[sensor].port = port;
+    routes[sensor].rxPin = rxPin;
+    routes[sensor].txPin = txPin;
+    if (owner[port] != UART_NO_OWNER) {
+        ports[port]->end();
+        owner[port] = UART_NO_OWNER;
+    }
+    return true;
+}
+
+int8_t UartPortManager::find(const char* name) const {
+    for (uint8_t i = 0; i < UART_SENSOR_COUNT; i++) {
+        if (strcasecmp(routes[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+void UartPortManager::printRoutes() {
+    for (uint8_t i = 0; i < UART_SENSOR_COUNT; i++) {
+        const UartRoute& r = routes[i];
+        Serial.printf("PORT %s %u %d %d %lu %s\n", r.name, r.port, r.rxPin, r.txPin, (unsigned long)r.baud,
+                      active[i] ? (shared(i) ? "shared" : "exclusive") : "unused");
+    }
+    Serial.printf("END %lu\n", (unsigned long)switches);
+}
@@ -0,0 +1,81 @@
+#ifndef uartPorts_h
+#define uartPorts_h
+
+#include <Arduino.h>
+
+// UART port manager: the ESP32-C3 has two UARTs (Serial0, Serial1) for more
+// UART sensors than that. Every sensor has a route (port, RX/TX pins, baud);
+// sensors routed to the same port take turns, acquire() switches the port's
+// pins through the GPIO matrix and its baud rate when another sensor used it
+// last. Sensors that share a port must only talk when asked (SPS30, Cubic,
+// PMS in passive mode), so nothing is sent while they are not routed. Each
+// sensor is wired to its own pins, see the pin map in OpenAirMultiSense.h;
+// the SHARED_UART build time-slices Serial0 between the SPS30 and a PMS5003.
+// Routes can be changed at runtime with the "port" command.
+enum uartSensors {
+    UART_SPS30 = 0,
+    UART_PM2012,
+    UART_PMS5003,
+    UART_PMS7003,
+    UART_SENSOR_COUNT
+};
+
+#define UART_PORT_COUNT     2
+#define UART_NO_OWNER       -1
+
+struct UartRoute {
+    const char* name;
+    uint8_t port;       // 0: Serial0, 1: Serial1
+    int8_t rxPin;       // -1: default pin of the port
+    int8_t txPin;
+    uint32_t baud;
+};
+
+class UartPortManager {
+public:
+    UartPortManager();
+
+    /**
+     * Registers a sensor of the active set, so other sensors on its port
+     * know they share it.
+     */
+    void attach(uint8_t sensor);
+
+    /**
+     * Routes the sensor's port to it. Returns true if the port was
+     * (re)configured, i.e. the sensor's protocol state should restart.
+     */
+    bool acquire(uint8_t sensor);
+
+    Stream& port(uint8_t sensor) { return *ports[routes[sensor].port]; }
+
+    // Discards what the sensor's port received, e.g. before a probe
+    void drain(uint8_t sensor);
+    bool shared(uint8_t sensor) const;
+    const UartRoute& route(uint8_t sensor) const { return routes[sensor]; }
+
+    /**
+     * Moves a sensor to another port and/or pins, applied on its next acquire().
+     * @return false for an unknown port.
+     */
+    bool remap(uint8_t sensor, uint8_t port, int8_t rxPin, int8_t txPin);
+
+    /**
+     * @return Sensor with this (case-insensitive) name, -1 if there is none.
+     */
+    int8_t find(const char* name) const;
+
+    void printRoutes();
+
+    uint32_t switches = 0;      // Port reconfigurations since boot
+
+private:
+    HardwareSerial* ports[UART_PORT_COUNT];
+    int8_t owner[UART_PORT_COUNT];
+    UartRoute routes[UART_SENSOR_COUNT];
+    bool active[UART_SENSOR_COUNT];
+};
+
+extern UartPortManager uartPorts;
+
+#endif  // uartPorts.h
@@ -33,7 +33,9 @@ public:
     
   };
 
+  PMS();
   PMS(Stream&);
+  void begin(Stream&);
   void sleep();
   void wakeUp();
   void activeMode();
@@ -42,13 +44,24 @@ public:
   void requestRead();
   bool read(DATA& data);
   bool readUntil(DATA& data, uint16_t timeout = SINGLE_RESPONSE_TIME);
+  bool readLatest(DATA& data, uint16_t timeout = SINGLE_RESPONSE_TIME);
+  uint32_t checksumErrors() const { return _checksumErrors; }
+
+  // millis() when the last good frame was parsed. For a frame that was already
+  // queued in the RX buffer this is later than its actual arrival.
+  uint32_t frameTime() const { return _frameTime; }
+  uint32_t age() const;
+  // Good frames readLatest() discarded for a newer one
+  uint16_t supersededFrames() const { return _superseded; }
+  // The last readLatest() found its frame already queued, without waiting
+  bool wasBuffered() const { return _buffered; }
 
 private:
   enum STATUS { STATUS_WAITING, STATUS_OK };
   enum MODE { MODE_ACTIVE, MODE_PASSIVE };
 
   uint8_t _payload[24];
-  Stream* _stream;
+  Stream* _stream = NULL;
   DATA* _data;
   STATUS _status;
   MODE _mode = MODE_ACTIVE;
@@ -57,6 +70,10 @@ private:
   uint16_t _frameLen;
   uint16_t _checksum;
   uint16_t _calculatedChecksum;
+  uint32_t _checksumErrors = 0;
+  uint32_t _frameTime = 0;
+  uint16_t _superseded = 0;
+  bool _buffered = false;
 
   void loop();
 };
@@ -1,11 +1,22 @@
 #include "Arduino.h"
 #include "PMS_custom.h"
 
+PMS::PMS()
+{
+}
+
 PMS::PMS(Stream& stream)
 {
   this->_stream = &stream;
 }
 
+// (Re)attach the sensor's serial port and drop any partially parsed frame.
+void PMS::begin(Stream& stream)
+{
+  this->_stream = &stream;
+  _index = 0;
+}
+
 // Standby mode. For low power consumption and prolong the life of the sensor.
 void PMS::sleep()
 {
@@ -36,11 +47,13 @@ void PMS::passiveMode()
   _mode = MODE_PASSIVE;
 }
 
-// Request read in Passive Mode.
+// Request read in Passive Mode. Anything still queued predates the request and is dropped.
 void PMS::requestRead()
 {
   if (_mode == MODE_PASSIVE)
   {
+    while (_stream->available()) _stream->read();
+    _index = 0;
     uint8_t command[] = { 0x42, 0x4D, 0xE2, 0x00, 0x00, 0x01, 0x71 };
     _stream->write(command, sizeof(command));
   }
@@ -69,6 +82,38 @@ bool PMS::readUntil(DATA& data, uint16_t timeout)
   return _status == STATUS_OK;
 }
 
+// Blocking function for parse the newest frame. Drains the RX buffer, so frames
+// queued while the caller was busy are superseded by the last good one instead of
+// being returned in order. Waits up to timeout for a frame only if none is queued.
+bool PMS::readLatest(DATA& data, uint16_t timeout)
+{
+  _data = &data;
+  _superseded = 0;
+  bool found = false;
+  while (_stream->available())
+  {
+    loop();
+    if (_status == STATUS_OK)
+    {
+      if (found) _superseded++;
+      found = true;
+    }
+  }
+  _buffered = found;
+  if (found)
+  {
+    _status = STATUS_OK;
+    return true;
+  }
+  return readUntil(data, timeout);
+}
+
+// Age of the last good frame [ms].
+uint32_t PMS::age() const
+{
+  return millis() - _frameTime;
+}
+
 void PMS::loop()
 {
   _status = STATUS_WAITING;
@@ -123,6 +168,7 @@ void PMS::loop()
         if (_calculatedChecksum == _checksum)
         {
           _status = STATUS_OK;
+          _frameTime = millis();
 
           // Standard Particles, CF=1.
           _data->PM_SP_UG_1_0 = makeWord(_payload[0], _payload[1]);
@@ -142,6 +188,10 @@ void PMS::loop()
           _data->PM_PC_5_0 = makeWord(_payload[20], _payload[21]);
           _data->PM_PC_10_0 = makeWord(_payload[22], _payload[23]);
         }
+        else
+        {
+          _checksumErrors++;
+        }
 
         _index = 0;
         return;
@@ -155,7 +205,6 @@ void PMS::loop()
         if (payloadIndex < sizeof(_payload))
         {
           _payload[payloadIndex] = ch;
-          Serial.printf("Payload[%d]: %x\n", payloadIndex, _payload[payloadIndex]);
         }
       }
 
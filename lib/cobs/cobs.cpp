@@ -0,0 +1,24 @@
+#include "cobs.h"
+
+size_t cobsEncode(const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t out = 1;         // Next free byte
+    size_t codePos = 0;     // Where the current block's length code goes
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[codePos] = code;
+            codePos = out++;
+            code = 1;
+            continue;
+        }
+        dst[out++] = src[i];
+        if (++code == 0xFF) {   // Block full, start a new one
+            dst[codePos] = code;
+            codePos = out++;
+            code = 1;
+        }
+    }
+    dst[codePos] = code;
+    return out;
+}
@@ -0,0 +1,14 @@
+#ifndef COBS_H
+#define COBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Consistent Overhead Byte Stuffing: the encoded block contains no 0x00,
+// so 0x00 can delimit frames on a byte stream. 'dst' must hold at least
+// COBS_MAX_ENCODED(len) bytes. Returns the number of bytes written.
+#define COBS_MAX_ENCODED(len)   ((len) + (len) / 254 + 1)
+
+size_t cobsEncode(const uint8_t* src, size_t len, uint8_t* dst);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32 (IEEE 802.3, reflected 0xEDB88320), identical to Python's zlib.crc32().
+// Start with crc = 0 and feed the previous result back to checksum data in pieces.
+uint32_t crc32Update(uint32_t crc, const uint8_t* buf, size_t len);
+
+#endif
@@ -0,0 +1,70 @@
+#include "cubicPmI2c.h"
+
+#define cmd_setupContinuousMeasurement  0x03
+
+
+Cubic_PMsensor_I2C::Cubic_PMsensor_I2C(TwoWire& wire, uint8_t address) : _wire(wire), _address(address) {}
+
+bool Cubic_PMsensor_I2C::begin() {
+    // Frame: [HEAD][LEN][CMD][DATA1][DATA2][RESERVED][XOR], 0xFFFF = measure continuously
+    uint8_t cmd[] = {CUBIC_I2C_HEADER, 0x07, cmd_setupContinuousMeasurement, 0xFF, 0xFF, 0x00, 0x00};
+    for (uint8_t i = 0; i < sizeof(cmd) - 1; i++) cmd[sizeof(cmd) - 1] ^= cmd[i];
+
+    _wire.beginTransmission(_address);
+    _wire.write(cmd, sizeof(cmd));
+    _length = 0;
+    return _wire.endTransmission() == 0;
+}
+
+bool Cubic_PMsensor_I2C::requestMeasurement() {
+    uint8_t size = _short ? CUBIC_I2C_SHORT_SIZE : CUBIC_I2C_FRAME_SIZE;
+    _length = _wire.requestFrom(_address, size);
+    for (uint8_t i = 0; i < _length; i++) _frame[i] = _wire.read();
+    if (_length == size) return true;
+
+    _lastError = CUBIC_ERR_TIMEOUT;
+    _length = 0;
+    return false;
+}
+
+bool Cubic_PMsensor_I2C::readMeasurement(PMData& data) {
+    if (_length == 0 && !requestMeasurement()) return false;
+    uint8_t length = _length;
+    _length = 0;        // A frame is parsed once
+
+    if (_frame[0] != CUBIC_I2C_HEADER) {
+        _lastError = CUBIC_ERR_FRAME;
+        return false;
+    }
+    if (length == CUBIC_I2C_FRAME_SIZE) {
+        uint8_t check = 0;
+        for (uint8_t i = 0; i < CUBIC_I2C_FRAME_SIZE - 1; i++) check ^= _frame[i];
+        if (check != _frame[CUBIC_I2C_FRAME_SIZE - 1]) {
+            _lastError = CUBIC_ERR_CHECKSUM;
+            return false;
+        }
+    }
+    _lastError = CUBIC_ERR_NONE;
+    _status = _frame[2];
+
+    // Data Mapping (2 bytes per value, Big Endian)
+    data.pm1_0_grimm = parseUint16(&_frame[7]);
+    data.pm2_5_grimm = parseUint16(&_frame[9]);
+    data.pm10_grimm  = parseUint16(&_frame[11]);
+    data.pm1_0_tsi   = parseUint16(&_frame[13]);
+    data.pm2_5_tsi   = parseUint16(&_frame[15]);
+    data.pm10_tsi    = parseUint16(&_frame[17]);
+    data.count_0_3   = parseUint16(&_frame[19]);
+    if (length == CUBIC_I2C_FRAME_SIZE) {
+        data.count_0_5   = parseUint16(&_frame[21]);
+        data.count_1_0   = parseUint16(&_frame[23]);
+        data.count_2_5   = parseUint16(&_frame[25]);
+        data.count_5_0   = parseUint16(&_frame[27]);
+        data.count_10    = parseUint16(&_frame[29]);
+    }
+    return true;
+}
+
+uint16_t Cubic_PMsensor_I2C::parseUint16(const uint8_t* buf) {
+    return ((uint16_t)buf[0] << 8) | buf[1];
+}
@@ -0,0 +1,57 @@
+#ifndef CUBIC_PM_I2C_H
+#define CUBIC_PM_I2C_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "cubicPmData.h"
+
+// Cubic PM2016 (and PM2008) over I2C. The PM2016 runs the PM2008 firmware:
+// a read returns a 32-byte frame, big-endian values, XOR checksum at the end.
+// FRAME Breakdown:
+// 0      : 0x16 (Header)
+// 1      : Frame length
+// 2      : Sensor status
+// 3-4    : Measuring mode
+// 5-6    : Calibration coefficient
+// 7-12   : PM1.0, PM2.5, PM10 [GRIMM]
+// 13-18  : PM1.0, PM2.5, PM10 [TSI]
+// 19-30  : Particles >0.3, >0.5, >1.0, >2.5, >5.0, >10 um
+// 31     : XOR of bytes 0-30
+#define CUBIC_I2C_ADDRESS       0x28
+#define CUBIC_I2C_FRAME_SIZE    32
+#define CUBIC_I2C_SHORT_SIZE    21  // Up to the >0.3um count, without the checksum
+#define CUBIC_I2C_HEADER        0x16
+
+class Cubic_PMsensor_I2C {
+public:
+    Cubic_PMsensor_I2C(TwoWire& wire = Wire, uint8_t address = CUBIC_I2C_ADDRESS);
+    ~Cubic_PMsensor_I2C(){};
+
+    // Starts continuous measurement
+    bool begin();
+
+    // Bus transfer of the current frame into the driver, parsed later by readMeasurement()
+    bool requestMeasurement();
+
+    // Parses the requested frame (requests one first if there is none)
+    bool readMeasurement(PMData& data);
+
+    // Reads only the first CUBIC_I2C_SHORT_SIZE bytes. The frame then can't
+    // be checksummed and the >0.5um..>10um counts in PMData aren't updated.
+    void setShortRead(bool enable) {_short = enable;}
+
+    uint8_t lastError() const {return _lastError;}
+    uint8_t status() const {return _status;}
+
+private:
+    TwoWire& _wire;
+    uint8_t _address;
+    uint8_t _frame[CUBIC_I2C_FRAME_SIZE];
+    uint8_t _length = 0;        // Bytes of a requested, not yet parsed frame
+    bool _short = false;
+    uint8_t _lastError = CUBIC_ERR_NONE;
+    uint8_t _status = 0;
+    uint16_t parseUint16(const uint8_t* buf);
+};
+
+#endif
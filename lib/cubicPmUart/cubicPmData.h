@@ -0,0 +1,29 @@
+#ifndef CUBIC_PM_DATA_H
+#define CUBIC_PM_DATA_H
+
+#include <Arduino.h>
+
+// Data model shared by the Cubic drivers (PM2012 over UART, PM2016 over I2C)
+
+// lastError() of a failed read
+#define CUBIC_ERR_NONE      0
+#define CUBIC_ERR_TIMEOUT   1   // No or incomplete response
+#define CUBIC_ERR_FRAME     2   // Unexpected header, length or command
+#define CUBIC_ERR_CHECKSUM  3
+
+struct PMData {
+    uint32_t pm1_0_grimm;
+    uint32_t pm2_5_grimm;
+    uint32_t pm10_grimm;
+    uint32_t pm1_0_tsi;
+    uint32_t pm2_5_tsi;
+    uint32_t pm10_tsi;
+    uint32_t count_0_3;
+    uint32_t count_0_5;
+    uint32_t count_1_0;
+    uint32_t count_2_5;
+    uint32_t count_5_0;
+    uint32_t count_10;
+};
+
+#endif
@@ -11,24 +11,40 @@
 #define cmd_serialNumber                    0x1f
 
 
-Cubic_PMsensor_UART::Cubic_PMsensor_UART(Stream& serial) : _serial(serial) {}
+Cubic_PMsensor_UART::Cubic_PMsensor_UART(Stream& serial) : _serial(&serial) {}
 
 bool Cubic_PMsensor_UART::readMeasurement(PMData& data) {
     // Command to read concentration and particle number
     uint8_t cmd[] = {0x11, 0x02, cmd_readParticleMeasurement, 0x07, 0xDB};
-    _serial.write(cmd, 5);
+
+    // Drop the tail of an earlier reply that came after its read timed out
+    while (_serial->available()) _serial->read();
+    _serial->write(cmd, 5);
 
     uint8_t response[56];
     memset(response, 0, 56);
 
-    // Wait for response (Start: 0x16, Length: 0x35 (53 bytes))
-    if (_serial.readBytes(response, 56) != 56) return false;
-    if (response[0] != 0x16 || response[1] != 0x35 || response[2] != 0x0B) return false;
+    // Wait for response (Start: 0x16, Length: 0x35 (53 bytes)), resyncing on
+    // the header if bytes of a late reply are still arriving
+    _lastError = CUBIC_ERR_TIMEOUT;
+    uint8_t skipped = 0;
+    while (response[0] != 0x16 || response[1] != 0x35 || response[2] != 0x0B) {
+        if (skipped++ == sizeof(response)) {
+            _lastError = CUBIC_ERR_FRAME;
+            return false;
+        }
+        response[0] = response[1];
+        response[1] = response[2];
+        if (_serial->readBytes(&response[2], 1) != 1) return false;
+    }
+    if (_serial->readBytes(response + 3, 53) != 53) return false;
 
     // Verify Checksum: sum of bytes 0 to 54 + byte 55 should = 256 (0x00 in 8-bit)
     uint8_t sum = 0;
     for (int i = 0; i < 55; i++) sum += response[i];
+    _lastError = CUBIC_ERR_CHECKSUM;
     if ((uint8_t)(256 - sum) != response[55]) return false;
+    _lastError = CUBIC_ERR_NONE;
     
     // Serial.printf("Measurement raw data: ");
     // for (int i = 0; i < sizeof(response); i++) {
@@ -74,9 +90,9 @@ bool Cubic_PMsensor_UART::closeFanAndLaser() {
 
 bool Cubic_PMsensor_UART::getSoftwareVersion(char* version) {
     uint8_t cmd[] = {0x11, 0x01, 0x1E, 0xD0};
-    _serial.write(cmd, 4);
+    _serial->write(cmd, 4);
     uint8_t resp[20];
-    if (_serial.readBytes(resp, 20) > 0 && resp[2] == 0x1E) {
+    if (_serial->readBytes(resp, 20) > 0 && resp[2] == 0x1E) {
         memcpy(version, &resp[3], resp[1] - 1);
         return true;
     }
@@ -85,9 +101,9 @@ bool Cubic_PMsensor_UART::getSoftwareVersion(char* version) {
 
 bool Cubic_PMsensor_UART::getSerialNumber(char* version) {
     uint8_t cmd[] = {0x11, 0x01, 0x1F, 0xCF};
-    _serial.write(cmd, 4);
+    _serial->write(cmd, 4);
     uint8_t resp[20];
-    if (_serial.readBytes(resp, 20) > 0 && resp[2] == 0x1E) {
+    if (_serial->readBytes(resp, 20) > 0 && resp[2] == 0x1E) {
         memcpy(version, &resp[3], resp[1] - 1);
         return true;
     }
@@ -110,15 +126,15 @@ bool Cubic_PMsensor_UART::_sendCommand(uint8_t* cmd, uint8_t len) {
     // Frame: [HEAD][LEN][CMD][DATA][CHKSUM]
 
     // 1. Clear any old data in the serial buffer
-    while(_serial.available()) _serial.read();
+    while(_serial->available()) _serial->read();
 
     // 2. Send the command bytes
-    _serial.write(cmd, len);
+    _serial->write(cmd, len);
 
     // 3. The sensor always responds with a 4-byte ACK for commands
     // Format: 0x16 (Header) + 0x02 (Length) + Command + CS (Checksum)
     uint8_t ack[4];
-    if (_serial.readBytes(ack, 4) == 4) {
+    if (_serial->readBytes(ack, 4) == 4) {
         if (ack[0] == 0x16 && ack[2] == cmd[2]) {
             // Verify Checksum: (Sum of first 3 bytes + CS) % 256 should be 0
             uint8_t sum = ack[0] + ack[1] + ack[2];
@@ -2,28 +2,16 @@
 #define PM2012_H
 
 #include <Arduino.h>
-
-struct PMData {
-    uint32_t pm1_0_grimm;
-    uint32_t pm2_5_grimm;
-    uint32_t pm10_grimm;
-    uint32_t pm1_0_tsi;
-    uint32_t pm2_5_tsi;
-    uint32_t pm10_tsi;
-    uint32_t count_0_3;
-    uint32_t count_0_5;
-    uint32_t count_1_0;
-    uint32_t count_2_5;
-    uint32_t count_5_0;
-    uint32_t count_10;
-};
+#include "cubicPmData.h"
 
 class Cubic_PMsensor_UART {
 public:
+    Cubic_PMsensor_UART() : _serial(NULL) {}
     Cubic_PMsensor_UART(Stream& serial);
     ~Cubic_PMsensor_UART(){};
-    void begin(HardwareSerial& serial) {_serial = serial;}
+    void begin(Stream& serial) {_serial = &serial;}
     bool readMeasurement(PMData& data);
+    uint8_t lastError() const {return _lastError;}
     bool openParticleMeasurement(void);
     bool closeParticleMeasurement(void);
     bool getSoftwareVersion(char* version);
@@ -32,7 +20,8 @@ public:
     bool closeFanAndLaser();
 
 private:
-    Stream& _serial;
+    Stream* _serial;
+    uint8_t _lastError = CUBIC_ERR_NONE;
     uint8_t calculateChecksum(uint8_t* buf, uint8_t len);
     uint32_t parseUint32(uint8_t* buf);
     bool _sendCommand(uint8_t* cmd, uint8_t len);
@@ -0,0 +1,104 @@
+#include "lzss.h"
+
+LzssEncoder::LzssEncoder(Print& out, uint8_t deltaStride)
+    : _out(out), _stride(min(deltaStride, (uint8_t)LZSS_MAX_STRIDE)) {
+    memset(_raw, 0, sizeof(_raw));
+    memset(_head, 0, sizeof(_head));
+    memset(_prev, 0, sizeof(_prev));
+}
+
+void LzssEncoder::write(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t value = data[i];
+        if (_stride) {
+            uint8_t& earlier = _raw[_end % _stride];
+            value = data[i] - earlier;
+            earlier = data[i];
+        }
+        _ring[_end++ & RING_MASK] = value;
+        if (_end - _pos == LZSS_MAX_MATCH) encodeToken();
+    }
+}
+
+void LzssEncoder::finish() {
+    while (_pos < _end) encodeToken();
+    if (_bitCount > 0) putBits(0, 8 - _bitCount);
+    flushOut();
+}
+
+uint16_t LzssEncoder::hash(uint32_t pos) const {
+    uint16_t h = _ring[pos & RING_MASK];
+    h = (h << 3) ^ _ring[(pos + 1) & RING_MASK];
+    h = (h << 3) ^ _ring[(pos + 2) & RING_MASK];
+    return (h ^ (h >> LZSS_HASH_BITS)) & (HASH_SIZE - 1);
+}
+
+void LzssEncoder::encodeToken() {
+    // Chain the positions behind _pos that have their LZSS_MIN_MATCH bytes
+    for (; _hashed < _pos && _hashed + LZSS_MIN_MATCH <= _end; _hashed++) {
+        uint16_t h = hash(_hashed);
+        _prev[_hashed % LZSS_WINDOW_SIZE] = _head[h];
+        _head[h] = _hashed;
+    }
+
+    uint32_t lookahead = min((uint32_t)LZSS_MAX_MATCH, _end - _pos);
+    uint32_t bestLen = 0;
+    uint32_t bestDist = 0;
+
+    // Nearest candidates first: log records repeat every sizeof(SensorPayload).
+    // Positions are kept as 16 bits; a stale entry can only cost a comparison,
+    // every match is checked against the ring.
+    if (lookahead >= LZSS_MIN_MATCH) {
+        uint16_t s = _head[hash(_pos)];
+        uint16_t lastDist = 0;
+        for (uint8_t n = 0; n < LZSS_MAX_CHAIN; n++) {
+            uint16_t dist = (uint16_t)_pos - s;
+            if (dist <= lastDist || dist > LZSS_WINDOW_SIZE || dist > _pos) break;
+            uint32_t len = 0;
+            while (len < lookahead && _ring[(_pos - dist + len) & RING_MASK] == _ring[(_pos + len) & RING_MASK]) len++;
+            if (len > bestLen) {
+                bestLen = len;
+                bestDist = dist;
+                if (len == lookahead) break;
+            }
+            lastDist = dist;
+            s = _prev[s % LZSS_WINDOW_SIZE];
+        }
+    }
+
+    if (bestLen >= LZSS_MIN_MATCH) {
+        putBits(0, 1);
+        putBits(bestDist - 1, LZSS_WINDOW_BITS);
+        putBits(bestLen - LZSS_MIN_MATCH, LZSS_LENGTH_BITS);
+        _pos += bestLen;
+    } else {
+        putBits(1, 1);
+        putBits(_ring[_pos & RING_MASK], 8);
+        _pos++;
+    }
+}
+
+void LzssEncoder::putBits(uint16_t value, uint8_t count) {
+    while (count--) {
+        _bits = (_bits << 1) | ((value >> count) & 1);
+        if (++_bitCount == 8) {
+            _outBuf[_outLen++] = _bits;
+            _bits = 0;
+            _bitCount = 0;
+            if (_outLen == sizeof(_outBuf)) flushOut();
+        }
+    }
+}
+
+void LzssEncoder::flushOut() {
+    _out.write(_outBuf, _outLen);
+    _written += _outLen;
+    _outLen = 0;
+}
+
+size_t LzssBufferSink::write(const uint8_t* buf, size_t len) {
+    len = min(len, _capacity - _len);
+    memcpy(_buf + _len, buf, len);
+    _len += len;
+    return len;
+}
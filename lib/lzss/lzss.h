@@ -0,0 +1,85 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <Arduino.h>
+
+// LZSS stream compressor with a fixed 256-byte window (heatshrink-style),
+// small enough to run on the C3 next to sampling. Bitstream, MSB first:
+//   1 + 8 bits               literal byte
+//   0 + 8 bits + 4 bits      back-reference: distance-1, length-LZSS_MIN_MATCH
+// The stream is zero padded to a whole byte; a decoder stops when fewer
+// bits than one token remain.
+// With a delta stride, every input byte is first replaced by its difference
+// to the byte 'stride' positions earlier (mod 256). With the record size as
+// stride, slowly varying values and counters turn into runs of zeros.
+// Matches are found through hash chains over the first LZSS_MIN_MATCH bytes,
+// nearest first, at most LZSS_MAX_CHAIN candidates per token.
+#define LZSS_WINDOW_BITS    8
+#define LZSS_LENGTH_BITS    4
+#define LZSS_WINDOW_SIZE    (1 << LZSS_WINDOW_BITS)
+#define LZSS_MIN_MATCH      3
+#define LZSS_MAX_MATCH      (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+#define LZSS_MAX_ENCODED(len)   ((len) + (len) / 8 + 1)
+#define LZSS_MAX_STRIDE     64
+#define LZSS_HASH_BITS      8
+#define LZSS_MAX_CHAIN      64
+
+// Archive file header ("pmLogsN.lz"), followed by the bitstream
+struct __attribute__((packed)) LzssFileHeader {
+    char magic[2] = {0x4f, 0x5a};   // 2 bytes  'OZ'
+    uint8_t windowBits = LZSS_WINDOW_BITS;
+    uint8_t lengthBits = LZSS_LENGTH_BITS;
+    uint8_t deltaStride;            // 1 byte   0 = no delta filter
+    uint32_t originalSize;          // 4 bytes  uncompressed size
+};
+
+class LzssEncoder {
+public:
+    LzssEncoder(Print& out, uint8_t deltaStride = 0);
+    ~LzssEncoder(){};
+    void write(const uint8_t* data, size_t len);
+    void finish();                  // Encode what is left and flush
+    uint32_t bytesIn() {return _end;}
+    uint32_t bytesOut() {return _written;}
+
+private:
+    static const uint16_t RING_SIZE = 512;     // Window + lookahead, power of two
+    static const uint16_t RING_MASK = RING_SIZE - 1;
+    static const uint16_t HASH_SIZE = 1 << LZSS_HASH_BITS;
+
+    Print& _out;
+    uint8_t _stride;
+    uint8_t _raw[LZSS_MAX_STRIDE];  // Last '_stride' input bytes for the delta filter
+    uint8_t _ring[RING_SIZE];
+    uint32_t _pos = 0;              // Next byte to encode
+    uint32_t _end = 0;              // Bytes received
+    uint32_t _hashed = 0;           // Next position to add to the hash chains
+    uint16_t _head[HASH_SIZE];      // Newest position (low 16 bits) per hash
+    uint16_t _prev[LZSS_WINDOW_SIZE];   // Next older position with the same hash
+    uint8_t _bits = 0;
+    uint8_t _bitCount = 0;
+    uint8_t _outBuf[64];
+    uint8_t _outLen = 0;
+    uint32_t _written = 0;
+
+    void encodeToken();
+    uint16_t hash(uint32_t pos) const;
+    void putBits(uint16_t value, uint8_t count);
+    void flushOut();
+};
+
+// Print target that fills a caller-owned buffer, e.g. for one download frame
+class LzssBufferSink : public Print {
+public:
+    LzssBufferSink(uint8_t* buf, size_t capacity) : _buf(buf), _capacity(capacity) {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) override;
+    size_t length() {return _len;}
+
+private:
+    uint8_t* _buf;
+    size_t _capacity;
+    size_t _len = 0;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "sps30Shdlc.h"
+
+#define cmd_startMeasurement        0x00
+#define cmd_stopMeasurement         0x01
+#define cmd_readMeasuredValues      0x03
+#define cmd_deviceInformation       0xD0
+
+#define SPS30_ADDRESS               0x00
+
+
+void Sps30_SHDLC::begin(Stream& serial) {
+    _serial = &serial;
+    _pending = false;
+    _escape = false;
+    _length = 0;
+}
+
+bool Sps30_SHDLC::startMeasurement(uint8_t format) {
+    uint8_t data[] = {0x01, format};
+    return transfer(cmd_startMeasurement, data, sizeof(data));
+}
+
+bool Sps30_SHDLC::stopMeasurement() {
+    return transfer(cmd_stopMeasurement, NULL, 0);
+}
+
+bool Sps30_SHDLC::readDeviceInfo(uint8_t type, char* text, uint8_t size) {
+    if (!transfer(cmd_deviceInformation, &type, 1) || size == 0) return false;
+    // Null-terminated ASCII string
+    uint8_t len = min(_dataLength, (uint8_t)(size - 1));
+    memcpy(text, _data, len);
+    text[len] = '\0';
+    return true;
+}
+
+void Sps30_SHDLC::requestMeasurement() {
+    sendFrame(cmd_readMeasuredValues, NULL, 0);
+}
+
+bool Sps30_SHDLC::poll() {
+    if (!_pending) return true;
+
+    while (_serial->available()) {
+        uint8_t c = _serial->read();
+        if (c == SPS30_SHDLC_START) {
+            // Start and stop bytes look the same: a start byte with nothing
+            // de-stuffed yet opens the frame, any other closes it
+            if (_length > 0) {
+                endFrame();
+                if (!_pending) return true;
+            }
+            _escape = false;
+            continue;
+        }
+        if (c == SPS30_SHDLC_ESCAPE) {
+            _escape = true;
+            continue;
+        }
+        if (_escape) {
+            c ^= 0x20;
+            _escape = false;
+        }
+        if (_length < sizeof(_frame)) {
+            _frame[_length] = c;
+        }
+        if (_length < 0xFF) _length++;  // Overlong frames are rejected in endFrame()
+    }
+    return false;
+}
+
+bool Sps30_SHDLC::waitResponse(uint16_t timeout) {
+    uint32_t start = millis();
+    while (!poll()) {
+        if (millis() - start >= timeout) {
+            _pending = false;
+            _lastError = SPS30_ERR_TIMEOUT;
+            return false;
+        }
+        yield();
+    }
+    return _lastError == SPS30_ERR_NONE;
+}
+
+bool Sps30_SHDLC::readValues(Sps30Values& values) const {
+    uint16_t* v = &values.mc1p0;
+    if (_dataLength == 20) {
+        for (uint8_t i = 0; i < 10; i++) v[i] = ((uint16_t)_data[2 * i] << 8) | _data[2 * i + 1];
+        return true;
+    }
+    if (_dataLength == 40) {
+        for (uint8_t i = 0; i < 10; i++) {
+            float f = parseFloat(&_data[4 * i]);
+            v[i] = f <= 0 ? 0 : f >= 65535 ? 65535 : (uint16_t)(f + 0.5f);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Sps30_SHDLC::readValues(Sps30FloatValues& values) const {
+    float* v = &values.mc1p0;
+    if (_dataLength == 40) {
+        for (uint8_t i = 0; i < 10; i++) v[i] = parseFloat(&_data[4 * i]);
+        return true;
+    }
+    if (_dataLength == 20) {
+        for (uint8_t i = 0; i < 10; i++) v[i] = ((uint16_t)_data[2 * i] << 8) | _data[2 * i + 1];
+        return true;
+    }
+    return false;
+}
+
+void Sps30_SHDLC::sendFrame(uint8_t command, const uint8_t* data, uint8_t len) {
+    // Frame: [0x7E][ADR][CMD][L][DATA...][CHK][0x7E]
+    // A response to an earlier request that was never collected is dropped
+    while (_serial->available()) _serial->read();
+
+    uint8_t sum = SPS30_ADDRESS + command + len;
+    _serial->write(SPS30_SHDLC_START);
+    writeStuffed(SPS30_ADDRESS);
+    writeStuffed(command);
+    writeStuffed(len);
+    for (uint8_t i = 0; i < len; i++) {
+        writeStuffed(data[i]);
+        sum += data[i];
+    }
+    writeStuffed(~sum);
+    _serial->write(SPS30_SHDLC_START);
+
+    _command = command;
+    _pending = true;
+    _escape = false;
+    _length = 0;
+    _dataLength = 0;
+    _lastError = SPS30_ERR_TIMEOUT;
+}
+
+bool Sps30_SHDLC::transfer(uint8_t command, const uint8_t* data, uint8_t len) {
+    sendFrame(command, data, len);
+    return waitResponse(SPS30_RESPONSE_TIME);
+}
+
+void Sps30_SHDLC::writeStuffed(uint8_t byte) {
+    if (byte == SPS30_SHDLC_START || byte == SPS30_SHDLC_ESCAPE || byte == 0x11 || byte == 0x13) {
+        _serial->write(SPS30_SHDLC_ESCAPE);
+        byte ^= 0x20;
+    }
+    _serial->write(byte);
+}
+
+void Sps30_SHDLC::endFrame() {
+    // De-stuffed MISO frame: [ADR][CMD][STATE][L][DATA...][CHK]
+    uint8_t length = _length;
+    _length = 0;
+    if (length < 5 || length > sizeof(_frame) || _frame[3] != length - 5) {
+        _lastError = SPS30_ERR_FRAME;
+    } else if (_frame[1] != _command) {
+        return;                         // Not ours, keep waiting
+    } else {
+        uint8_t sum = 0;
+        for (uint8_t i = 0; i < length - 1; i++) sum += _frame[i];
+        _state = _frame[2];
+        if ((uint8_t)~sum != _frame[length - 1]) {
+            _lastError = SPS30_ERR_CHECKSUM;
+        } else if (_state != 0) {
+            _lastError = SPS30_ERR_STATE;
+        } else if (_command == cmd_readMeasuredValues && _frame[3] == 0) {
+            _lastError = SPS30_ERR_NO_DATA;
+        } else {
+            _dataLength = _frame[3];
+            memcpy(_data, &_frame[4], _dataLength);
+            _lastError = SPS30_ERR_NONE;
+        }
+    }
+    _pending = false;
+}
+
+float Sps30_SHDLC::parseFloat(const uint8_t* buf) const {
+    uint32_t bits = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
@@ -0,0 +1,110 @@
+#ifndef SPS30_SHDLC_H
+#define SPS30_SHDLC_H
+
+#include <Arduino.h>
+
+// Sensirion SPS30 over UART (SHDLC, 115200 baud), split into sending a request
+// and collecting its response, so the exchange can run while other sensors
+// are read. Responses are de-stuffed byte by byte as they arrive.
+// FRAME Breakdown (between the 0x7E start/stop bytes):
+// MOSI   : ADR, CMD, L, DATA[L], CHK
+// MISO   : ADR, CMD, STATE, L, DATA[L], CHK
+// CHK    : inverted low byte of the sum of all bytes before it
+// 0x7E, 0x7D, 0x11, 0x13 inside a frame are sent as 0x7D, byte ^ 0x20
+#define SPS30_SHDLC_START       0x7E
+#define SPS30_SHDLC_ESCAPE      0x7D
+#define SPS30_SHDLC_MAX_DATA    40      // Measured values in float format
+#define SPS30_RESPONSE_TIME     100     // [ms] datasheet: < 20 ms for the commands used here
+
+// Output format of startMeasurement()
+#define SPS30_FORMAT_FLOAT      0x03    // 10 x big-endian IEEE754 float
+#define SPS30_FORMAT_UINT16     0x05    // 10 x big-endian uint16
+
+// readDeviceInfo() types
+#define SPS30_INFO_PRODUCT_TYPE     0x00
+#define SPS30_INFO_SERIAL_NUMBER    0x03
+
+// lastError() of a failed exchange
+#define SPS30_ERR_NONE      0
+#define SPS30_ERR_TIMEOUT   1   // No or incomplete response
+#define SPS30_ERR_FRAME     2   // Unexpected length or command
+#define SPS30_ERR_CHECKSUM  3
+#define SPS30_ERR_STATE     4   // The sensor answered with an error state, see state()
+#define SPS30_ERR_NO_DATA   5   // No new measurement since the last read
+
+// Measured values in the order the sensor sends them
+struct Sps30Values {
+    uint16_t mc1p0;
+    uint16_t mc2p5;
+    uint16_t mc4p0;
+    uint16_t mc10p0;
+    uint16_t nc0p5;
+    uint16_t nc1p0;
+    uint16_t nc2p5;
+    uint16_t nc4p0;
+    uint16_t nc10p0;
+    uint16_t typicalParticleSize;
+};
+
+struct Sps30FloatValues {
+    float mc1p0;
+    float mc2p5;
+    float mc4p0;
+    float mc10p0;
+    float nc0p5;
+    float nc1p0;
+    float nc2p5;
+    float nc4p0;
+    float nc10p0;
+    float typicalParticleSize;
+};
+
+class Sps30_SHDLC {
+public:
+    Sps30_SHDLC() : _serial(NULL) {}
+    ~Sps30_SHDLC(){};
+    void begin(Stream& serial);
+
+    // Blocking commands for setup, each waits up to SPS30_RESPONSE_TIME
+    bool startMeasurement(uint8_t format);
+    bool stopMeasurement();
+    bool readDeviceInfo(uint8_t type, char* text, uint8_t size);
+
+    // Sends "read measured values", the response is collected by poll()
+    void requestMeasurement();
+
+    // Consumes the bytes received so far, true once the response is complete
+    // (see lastError()). Never blocks.
+    bool poll();
+
+    // poll() until the response is complete or timeout [ms] has passed
+    bool waitResponse(uint16_t timeout);
+
+    // Values of the last measurement response, in either format. Float
+    // values are rounded when read as uint16.
+    bool readValues(Sps30Values& values) const;
+    bool readValues(Sps30FloatValues& values) const;
+
+    uint8_t lastError() const {return _lastError;}
+    uint8_t state() const {return _state;}
+
+private:
+    Stream* _serial;
+    uint8_t _command = 0;               // Command of the pending request
+    bool _pending = false;
+    bool _escape = false;
+    uint8_t _frame[5 + SPS30_SHDLC_MAX_DATA];
+    uint8_t _length = 0;                // De-stuffed bytes of the frame in progress
+    uint8_t _data[SPS30_SHDLC_MAX_DATA];
+    uint8_t _dataLength = 0;            // Of the last complete response
+    uint8_t _state = 0;
+    uint8_t _lastError = SPS30_ERR_NONE;
+
+    void sendFrame(uint8_t command, const uint8_t* data, uint8_t len);
+    bool transfer(uint8_t command, const uint8_t* data, uint8_t len);
+    void writeStuffed(uint8_t byte);
+    void endFrame();
+    float parseFloat(const uint8_t* buf) const;
+};
+
+#endif
@@ -0,0 +1,159 @@
+import argparse
+import os
+import numpy as np
+from record_stream import iter_chunks, INVALID_VALUE, SENSOR_FIELDS
+
+# Puts the sensors of one session on a common uniform time grid, in one
+# streaming pass over the records:
+#  - Timestamp_ms is unwrapped (millis() wraps after ~49.7 days); a restart,
+#    i.e. the next session inside a partition image, continues after a gap
+#  - every channel is placed at its record's Timestamp_ms
+#  - 65535 (failed reading) is masked, nothing is carried or interpolated
+#    across it, across a counter gap (lost records) or across more than
+#    max_gap without a reading
+#  - 'locf' carries the last reading forward, 'linear' interpolates
+# Grid sample k is at t0 + k * dt on the unwrapped timeline, t0 being the
+# first record's time. Samples are emitted as soon as every channel has a
+# reading at or after them.
+METHODS = ("locf", "linear")
+
+class Timeline:
+    """
+    Turns logged Timestamp_ms values into one increasing timeline [ms]:
+    wraparounds are undone and a restart (time going back) continues
+    'restart_gap' after the last record.
+    """
+
+    def __init__(self, restart_gap):
+        self.restart_gap = int(restart_gap)
+        self.raw_last = None        # Last Timestamp_ms as logged
+        self.time_last = None       # ... and on the unwrapped timeline
+
+    def unwrap(self, raw):
+        """Returns (times, restart flag of every record)."""
+        if self.raw_last is None:
+            self.raw_last = self.time_last = int(raw[0])
+        delta = np.diff(raw, prepend=self.raw_last)
+        delta[delta < -(1 << 31)] += 1 << 32
+        restart = delta < 0
+        delta[restart] = self.restart_gap
+        self.raw_last = int(raw[-1])
+        times = self.time_last + np.cumsum(delta)
+        self.time_last = int(times[-1])
+        return times, restart
+
+class GridResampler:
+    def __init__(self, columns=SENSOR_FIELDS, dt=1.0, method="locf", max_gap=5.0):
+        if method not in METHODS:
+            raise ValueError(f"Unknown method {method}, use one of {METHODS}")
+        self.columns = list(columns)
+        self.dt_ms = dt * 1000.0
+        self.method = method
+        self.max_gap = max_gap * 1000.0
+
+        self.timeline = Timeline(self.max_gap + self.dt_ms)
+        self.t0 = None              # [ms] time of grid sample 0
+        self.counter_last = None
+        self.next_sample = 0        # Next grid sample to emit
+        # Last observation of every channel: time, value, and whether
+        # records were lost right before it
+        self.carry = [None] * len(self.columns)
+
+    def feed(self, chunk):
+        """
+        Takes a record chunk (record_stream.iter_chunks) and returns the
+        grid samples completed by it: (times [ms], matrix [samples x columns]).
+        """
+        raw = chunk["Timestamp_ms"].astype(np.int64)
+        if len(raw) == 0:
+            return self._empty()
+        times, restart = self.timeline.unwrap(raw)
+        if self.t0 is None:
+            self.t0 = int(times[0])
+
+        # Records lost before a record: counter not consecutive (or a restart)
+        counter = chunk["Counter"].astype(np.int64)
+        lost = np.diff(counter, prepend=counter[0] - 1 if self.counter_last is None else self.counter_last) != 1
+        lost |= restart
+        self.counter_last = int(counter[-1])
+
+        observations = []
+        for c, column in enumerate(self.columns):
+            t = times.astype(np.float64)
+            v = chunk[column].astype(np.float64)
+            v[v == INVALID_VALUE] = np.nan
+            b = lost.copy()
+            if self.carry[c] is not None:
+                t = np.concatenate([[self.carry[c][0]], t])
+                v = np.concatenate([[self.carry[c][1]], v])
+                b = np.concatenate([[self.carry[c][2]], b])
+            observations.append((t, v, b))
+
+        # Every channel must have a reading at or after an emitted sample
+        horizon = min(obs[0][-1] for obs in observations)
+        end = int((horizon - self.t0) // self.dt_ms) + 1
+        grid = self.t0 + np.arange(self.next_sample, max(end, self.next_sample)) * self.dt_ms
+        matrix = np.column_stack([self._resample(grid, *obs) for obs in observations]) \
+            if len(grid) else np.zeros((0, len(self.columns)))
+
+        for c, (t, v, b) in enumerate(observations):
+            self.carry[c] = (t[-1], v[-1], b[-1])
+        self.next_sample = max(end, self.next_sample)
+        return grid, matrix
+
+    def _empty(self):
+        return np.zeros(0), np.zeros((0, len(self.columns)))
+
+    def _resample(self, grid, t, v, lost):
+        index = np.searchsorted(t, grid, side='right') - 1
+        before = np.maximum(index, 0)
+        after = np.minimum(index + 1, len(t) - 1)
+        exact = t[before] == grid
+        # Interval [t[index], t[index + 1]) is usable when no record was lost in it
+        # and it isn't longer than max_gap
+        usable = (index >= 0) & (~lost[after] | (after == before)) & (grid - t[before] <= self.max_gap)
+
+        if self.method == "locf":
+            values = v[before]
+        else:
+            span = t[after] - t[before]
+            weight = np.divide(grid - t[before], span, out=np.zeros_like(grid), where=span > 0)
+            values = np.where(exact, v[before], v[before] * (1 - weight) + v[after] * weight)
+            usable &= exact | (span <= self.max_gap)
+        return np.where(usable | ((index >= 0) & exact), values, np.nan)
+
+def align_file(path, **options):
+    """Aligned (times [s from the first record], matrix) of a whole session, read chunk by chunk."""
+    resampler = GridResampler(**options)
+    times, blocks = [], []
+    for chunk in iter_chunks(path):
+        t, m = resampler.feed(chunk)
+        times.append(t)
+        blocks.append(m)
+    if resampler.t0 is None:
+        return np.zeros(0), np.zeros((0, len(resampler.columns)))
+    return (np.concatenate(times) - resampler.t0) / 1000.0, np.concatenate(blocks)
+
+def main():
+    parser = argparse.ArgumentParser(description='Resample a session onto a uniform time grid')
+    parser.add_argument('filename', help='Session (.bin, .lz, .csv or .arrow)')
+    parser.add_argument('--dt', type=float, default=1.0, help='Grid spacing [s]')
+    parser.add_argument('--method', choices=METHODS, default="locf")
+    parser.add_argument('--max-gap', type=float, default=5.0, help='Longest gap bridged [s]')
+    parser.add_argument('--output', help='CSV to write (default: <session>_aligned.csv)')
+    args = parser.parse_args()
+
+    output = args.output or os.path.splitext(args.filename)[0] + "_aligned.csv"
+    resampler = GridResampler(dt=args.dt, method=args.method, max_gap=args.max_gap)
+    samples = 0
+    with open(output, 'w') as f:
+        f.write(",".join(["Time_s"] + resampler.columns) + "\n")
+        for chunk in iter_chunks(args.filename):
+            times, matrix = resampler.feed(chunk)
+            if len(times):
+                np.savetxt(f, np.column_stack([(times - resampler.t0) / 1000.0, matrix]), delimiter=",", fmt="%.6g")
+                samples += len(times)
+    print(f"Finished! {samples} samples every {args.dt} s written to '{output}'.")
+
+if __name__ == "__main__":
+    main()
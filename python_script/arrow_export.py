@@ -0,0 +1,67 @@
+import os
+import numpy as np
+
+# Typed columnar copy of a decoded session, written next to its CSV as
+# <session>.arrow: an uncompressed Arrow IPC file (Feather v2), i.e. a schema
+# header followed by fixed-width little-endian columns. pandas/pyarrow can
+# memory-map it without parsing any text.
+# COLUMNS Breakdown (same names and order as the CSV):
+# Counter, Timestamp_ms         : uint32
+# 9 sensor values               : uint16 (65535 = no reading)
+COLUMNS = [
+    ('Counter', np.uint32), ('Timestamp_ms', np.uint32),
+    ('SPS30_Particles', np.uint16), ('SPS30_Conc', np.uint16),
+    ('PMSA_Particles', np.uint16), ('PMSA_Conc', np.uint16),
+    ('PM2012_Particles', np.uint16), ('PM2012_Conc_GRIMM', np.uint16), ('PM2012_Conc_TSI', np.uint16),
+    ('PM2016_Particles', np.uint16), ('PM2016_Conc', np.uint16),
+]
+
+def arrow_path(csv_path):
+    """decoded_results/pmLogs3.csv -> decoded_results/pmLogs3.arrow"""
+    return os.path.splitext(csv_path)[0] + ".arrow"
+
+def available():
+    try:
+        import pyarrow  # noqa: F401
+        return True
+    except ImportError:
+        return False
+
+def to_table(records):
+    """Arrow table from decoded records (convert_bin_ascii.RECORD_DTYPE array)."""
+    import pyarrow as pa
+
+    return pa.table({name: np.ascontiguousarray(records[name]).astype(dtype) for name, dtype in COLUMNS})
+
+def write_arrow(records, path, append=False):
+    """
+    Writes the records to 'path'. IPC files can't grow in place, so with
+    'append' the existing file is mapped, extended and rewritten.
+    """
+    import pyarrow as pa
+    from pyarrow import feather
+
+    table = to_table(records)
+    if append and os.path.exists(path):
+        table = pa.concat_tables([feather.read_table(path, memory_map=True), table])
+    tmp = path + ".tmp"
+    feather.write_feather(table, tmp, compression='uncompressed')
+    os.replace(tmp, path)
+
+def csv_to_arrow(csv_path):
+    """Typed .arrow copy of a CSV written by another decoder (oalog), parsed by pyarrow's native reader."""
+    from pyarrow import csv, feather
+
+    names = [name for name, _ in COLUMNS]
+    types = {name: np.dtype(dtype).name for name, dtype in COLUMNS}
+    # Every row ends with a comma, i.e. an extra unnamed column
+    read = csv.ReadOptions(column_names=names + ["_"], skip_rows=1)
+    convert = csv.ConvertOptions(include_columns=names, column_types=types)
+    table = csv.read_csv(csv_path, read_options=read, convert_options=convert)
+    feather.write_feather(table, arrow_path(csv_path), compression='uncompressed')
+
+def read_arrow(path):
+    """Loads a .arrow session as a pandas DataFrame, memory-mapped."""
+    from pyarrow import feather
+
+    return feather.read_table(path, memory_map=True).to_pandas()
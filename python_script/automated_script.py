@@ -3,13 +3,17 @@ import os
 import glob
 import shutil
 import time
+import argparse
+import struct
+from decode_cache import decode_sessions
+from lzss import LZSS_HEADER_FORMAT, LZSS_HEADER_SIZE, is_archive
 
 # --- Configuration ---
 EXTRACT_SCRIPT = "extract_memory.py"
-DECODE_SCRIPT = "convert_bin_ascii.py"
 RAW_BIN = "./output_folder/littlefs_raw.bin"
 OUTPUT_DIR = "./extracted_files"
 DECODED_DIR = "./decoded_results"
+OALOG_BUILD = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools", "logReader", "build", "oalog")
 
 def update_file_time(path):
     """Updates the 'Date Modified' to the current time."""
@@ -17,6 +21,13 @@ def update_file_time(path):
         current_time = time.time()
         os.utime(path, (current_time, current_time))
 
+def find_oalog():
+    """Native decoder (tools/logReader), if it has been built: $OALOG, the build folder, or PATH."""
+    for candidate in [os.environ.get("OALOG"), OALOG_BUILD, shutil.which("oalog")]:
+        if candidate and os.path.isfile(candidate) and os.access(candidate, os.X_OK):
+            return candidate
+    return None
+
 def run_command(command_list, description):
     print(f"\n>>> Running: {description}...")
     result = subprocess.run(command_list)
@@ -26,18 +37,40 @@ def run_command(command_list, description):
     return True
 
 def main():
-    # 1. Clean up previous runs
-    for folder in [OUTPUT_DIR, DECODED_DIR]:
-        if os.path.exists(folder):
-            shutil.rmtree(folder)
-        os.makedirs(folder)
+    parser = argparse.ArgumentParser(description='ESP32-C3 log extraction pipeline')
+    parser.add_argument('--usb', action='store_true',
+                        help='Download only new records over USB (needs the OpenAir firmware running) instead of dumping the whole flash partition')
+    parser.add_argument('--sparse', action='store_true',
+                        help='Only read the flash blocks in use (needs the OpenAir firmware running)')
+    args = parser.parse_args()
+
+    # 1. Clean up previous runs. Decoded results are kept: only new and
+    # grown sessions are decoded again (see decode_cache.py)
+    if os.path.exists(OUTPUT_DIR):
+        shutil.rmtree(OUTPUT_DIR)
+    os.makedirs(OUTPUT_DIR)
+    os.makedirs(DECODED_DIR, exist_ok=True)
+
+    if args.usb:
+        # Incremental download keeps its own mirror, nothing to unpack
+        from sync_logs import sync_device
+        decode_folder(sync_device())
+        return
 
     # 2. Extract Raw Binary from ESP32
     # This runs your existing extract_memory.py script
-    if not run_command(["python3", EXTRACT_SCRIPT], "Hardware Extraction"):
+    extract_cmd = ["python3", EXTRACT_SCRIPT] + (["--sparse"] if args.sparse else [])
+    if not run_command(extract_cmd, "Hardware Extraction"):
         return
 
-    # 3. Unpack the LittleFS Image
+    # 3. Read the sessions straight out of the LittleFS image
+    try:
+        decode_image(RAW_BIN)
+        return
+    except ImportError:
+        print("littlefs-python is not installed, falling back to mklittlefs")
+
+    # Unpack the LittleFS Image
     # Using the specific parameters you provided
     mklittlefs_cmd = [
         "mklittlefs", 
@@ -51,39 +84,80 @@ def main():
         return
 
     # 4. Decode each extracted file
+    decode_folder(OUTPUT_DIR)
+
+def decode_image(image_path):
+    """Decodes every session inside a LittleFS partition dump in-process, without unpacking it to disk."""
+    from littlefs_image import load_image, sessions
+
+    print(f"\n>>> Decoding sessions inside {image_path}...")
+    fs = load_image(image_path)
+    found = [(name, data, None) for name, data in sessions(fs)]
+    if not found:
+        print("No sessions found inside the LittleFS partition. Is it formatted?")
+        return
+
+    for csv_path in decode_sessions(found, DECODED_DIR):
+        update_file_time(csv_path)
+    print(f"\n🎉 Done! {len(found)} sessions in {image_path} are decoded.")
+
+def archived_size(lz_path):
+    """Size of the session in a .lz archive (LZSS header originalSize), -1 if it isn't one."""
+    with open(lz_path, 'rb') as f:
+        header = f.read(LZSS_HEADER_SIZE)
+    if len(header) < LZSS_HEADER_SIZE or not is_archive(header):
+        return -1
+    return struct.unpack(LZSS_HEADER_FORMAT, header)[4]
+
+def is_preferred_copy(file_path):
+    """
+    With both pmLogsN.bin and pmLogsN.lz in the folder, decodes the larger session:
+    a .bin copied before the firmware archived it misses the archived tail. On a tie
+    the .bin wins, the archive may have been interrupted.
+    """
+    base = os.path.splitext(file_path)[0]
+    bin_path, lz_path = base + ".bin", base + ".lz"
+    if not (os.path.exists(bin_path) and os.path.exists(lz_path)):
+        return True
+    lz_wins = archived_size(lz_path) > os.path.getsize(bin_path)
+    return lz_wins if file_path == lz_path else not lz_wins
+
+def decode_folder(folder):
     print(f"\n>>> Decoding individual files...")
     # Find all files in the output directory
-    extracted_files = glob.glob(os.path.join(OUTPUT_DIR, "*"))
+    extracted_files = glob.glob(os.path.join(folder, "*"))
     
     if not extracted_files:
         print("No files found inside the LittleFS partition. Is it formatted?")
         return
 
-    for file_path in extracted_files:
+    found = []
+    for file_path in sorted(extracted_files):
 
         filename = os.path.basename(file_path)
         # Skip directories if any exist
         if os.path.isdir(file_path):
             continue
+        # Session indexes (.idx) are read by the decoder alongside their .bin
+        if file_path.endswith(".idx"):
+            continue
+        # A session mirrored both plain and archived decodes to the same CSV,
+        # only the copy that holds more of it is decoded
+        if file_path.endswith((".bin", ".lz")) and not is_preferred_copy(file_path):
+            continue
             
         # Update timestamp of the raw file from LittleFS
         update_file_time(file_path)
 
-        print(f"  Processing: {filename}")
-        
-        # Run your decoder script on this specific file
-        # We output the result to the DECODED_DIR
-        decode_cmd = ["python3", DECODE_SCRIPT, file_path]
-        subprocess.run(decode_cmd)
-
-        # Update timestamp of the resulting CSV
-        # base_name = os.path.basename(file_path)
-        csv_name = os.path.splitext(filename)[0] + ".csv"
-        # Search in the DECODED_DIR (as defined in your decode script)
-        csv_path = os.path.join(DECODED_DIR, csv_name)
+        with open(file_path, 'rb') as f:
+            found.append((filename, f.read(), file_path))
+
+    # New sessions in plain files go to the native decoder when it is built,
+    # everything else is decoded in parallel Python processes
+    for csv_path in decode_sessions(found, DECODED_DIR, oalog=find_oalog()):
         update_file_time(csv_path)
 
-    print(f"\n🎉 Done! Files extracted to {OUTPUT_DIR} and decoded.")
+    print(f"\n🎉 Done! Files extracted to {folder} and decoded.")
 
 if __name__ == "__main__":
     main()
\ No newline at end of file
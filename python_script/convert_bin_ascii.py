@@ -1,7 +1,11 @@
 import struct
 import argparse
+import numpy as np
 import os
 import sys
+from log_index import load_index, slice_bounds
+from lzss import is_archive, decompress_archive
+import arrow_export
 
 # ... rest of your conversion code ...
 # PACKET_FORMAT Breakdown:
@@ -28,7 +32,142 @@ FOOTER = (0xAA, 0xBB)
 OUTPUT_DIR = "./decoded_results"  # Change this to your desired path
 # --------------------------------
 
-def decode_sensor_file(input_filename):
+CSV_HEADER = "Counter,Timestamp_ms,SPS30_Particles,SPS30_Conc,PMSA_Particles,PMSA_Conc,PM2012_Particles,PM2012_Conc_GRIMM,PM2012_Conc_TSI,PM2016_Particles,PM2016_Conc\n"
+CSV_ROW = "%d," * 11 + "\n"
+
+# RECORD_DTYPE: the same 30 bytes as PACKET_FORMAT (SensorPayload), as a
+# numpy structured type so a whole session unpacks in one step. The value
+# fields carry the CSV column names.
+RECORD_DTYPE = np.dtype([
+    ('Header', 'S2'),
+    ('Counter', '<u4'), ('Timestamp_ms', '<u4'),
+    ('SPS30_Particles', '<u2'), ('SPS30_Conc', '<u2'),
+    ('PMSA_Particles', '<u2'), ('PMSA_Conc', '<u2'),
+    ('PM2012_Particles', '<u2'), ('PM2012_Conc_GRIMM', '<u2'), ('PM2012_Conc_TSI', '<u2'),
+    ('PM2016_Particles', '<u2'), ('PM2016_Conc', '<u2'),
+    ('Terminator', 'u1', 2),
+])
+VALUE_FIELDS = list(RECORD_DTYPE.names[1:-1])
+assert RECORD_DTYPE.itemsize == PACKET_SIZE
+
+# EVENT_DTYPE: EventRecord, logged between the records with header 'OE'.
+# Type 1 (sensor health): Source = sensor (0 SPS30, 1 PMSA003I, 2 PM2012,
+# 3 PM2016), Data0 = state (0 ok, 1 isolated), Data1 = consecutive failures,
+# Data2 = checksum errors, Data3 = smoothed latency [us]
+# Type 2 (power): Source = largest sample lateness [ms] since the last one,
+# Data0..2 = time active / idle / in light sleep [ms], Data3 = estimated
+# charge [uAh], all since boot (see power_report.py)
+# Type 3 (sensor power): Source = sensor, Data0 = 1 fan/laser on, 0 off
+# (duty cycle), Data1 = warm-up [ms] before its readings are used again
+# Type 4 (capture): Source = sensor that saw the plume (255: requested),
+# Data0 = 1 start / 0 end, Data1 = first / last record logged in full,
+# Data2 = signal (0 PM2.5, 1 particles, 2 requested), Data3 = trigger value
+EVENT_HEADER = b'OE'
+EVENT_DTYPE = np.dtype([
+    ('Header', 'S2'),
+    ('Counter', '<u4'), ('Timestamp_ms', '<u4'),
+    ('Type', 'u1'), ('Source', 'u1'),
+    ('Data0', '<u4'), ('Data1', '<u4'), ('Data2', '<u4'), ('Data3', '<u4'),
+    ('Terminator', 'u1', 2),
+])
+EVENT_FIELDS = list(EVENT_DTYPE.names[1:-1])
+EVENT_CSV_HEADER = ",".join(EVENT_FIELDS) + "\n"
+assert EVENT_DTYPE.itemsize == PACKET_SIZE
+
+def find_packets(raw_data, start=0, header=HEADER):
+    """
+    Offsets of the valid packets in raw_data[start:], the same ones a
+    byte-by-byte scan finds: every position is tested for the 'OA' header
+    and the terminator at once. Candidates only overlap in damaged regions
+    (or where sensor bytes happen to look like a packet); those few are
+    resolved in order like the byte-wise scan, which skips anything that
+    starts inside the previously accepted packet.
+    """
+    buf = np.frombuffer(raw_data, dtype=np.uint8)
+    n = len(buf) - PACKET_SIZE + 1 - start
+    if n <= 0:
+        return np.zeros(0, dtype=np.int64)
+
+    valid = ((buf[start:start + n] == header[0]) & (buf[start + 1:start + 1 + n] == header[1]) &
+             (buf[start + PACKET_SIZE - 2:start + PACKET_SIZE - 2 + n] == FOOTER[0]) &
+             (buf[start + PACKET_SIZE - 1:start + PACKET_SIZE - 1 + n] == FOOTER[1]))
+    offsets = np.flatnonzero(valid) + start
+
+    # A candidate at least PACKET_SIZE after its predecessor is always taken;
+    # only the others depend on which earlier candidates were taken
+    keep = np.ones(len(offsets), dtype=bool)
+    last = -PACKET_SIZE
+    for i in np.flatnonzero(np.diff(offsets) < PACKET_SIZE) + 1:
+        if keep[i - 1]:
+            last = offsets[i - 1]
+        if offsets[i] < last + PACKET_SIZE:
+            keep[i] = False
+    return offsets[keep]
+
+def decode_array(raw_data, start=0):
+    """
+    Decodes every valid packet in raw_data[start:] into a RECORD_DTYPE array.
+    Returns (records, consumed) with consumed the end of the last packet
+    (start if there was none).
+    """
+    offsets = find_packets(raw_data, start)
+    buf = np.frombuffer(raw_data, dtype=np.uint8)
+    packets = buf[offsets[:, None] + np.arange(PACKET_SIZE)]
+    records = np.ascontiguousarray(packets).view(RECORD_DTYPE).reshape(-1)
+    consumed = int(offsets[-1]) + PACKET_SIZE if len(offsets) else start
+    return records, consumed
+
+def decode_events(raw_data, start=0):
+    """The EventRecords in raw_data[start:] as an EVENT_DTYPE array. Returns (events, end of the last one)."""
+    offsets = find_packets(raw_data, start, EVENT_HEADER)
+    buf = np.frombuffer(raw_data, dtype=np.uint8)
+    events = np.ascontiguousarray(buf[offsets[:, None] + np.arange(PACKET_SIZE)]).view(EVENT_DTYPE).reshape(-1)
+    return events, int(offsets[-1]) + PACKET_SIZE if len(offsets) else start
+
+def events_path(csv_path):
+    """decoded_results/pmLogs3.csv -> decoded_results/pmLogs3_events.csv"""
+    return os.path.splitext(csv_path)[0] + "_events.csv"
+
+def write_events(events, output_filename, append=False):
+    """
+    Writes events (EVENT_DTYPE) next to the session's CSV as
+    <session>_events.csv, only if there are any. Returns their number.
+    """
+    if len(events) == 0:
+        return 0
+    path = events_path(output_filename)
+    new_file = not (append and os.path.exists(path))
+    with open(path, 'w' if new_file else 'a') as f:
+        if new_file:
+            f.write(EVENT_CSV_HEADER)
+        for row in zip(*[events[name].tolist() for name in EVENT_FIELDS]):
+            f.write(",".join(map(str, row)) + "\n")
+    return len(events)
+
+def value_columns(records):
+    """The 11 CSV values of every record as one uint32 row each."""
+    return np.stack([records[name].astype(np.uint32) for name in VALUE_FIELDS], axis=1) \
+        if len(records) else np.zeros((0, len(VALUE_FIELDS)), dtype=np.uint32)
+
+def decode_records(raw_data):
+    """Yields (count, ts, s1_p, s1_c, s2_p, s2_c, s3_p, s3_c_grimm, s3_c_tsi, s4_p, s4_c) for every valid packet."""
+    records, _ = decode_array(raw_data)
+    for row in value_columns(records).tolist():
+        yield tuple(row)
+
+def write_csv_rows(csv_file, records, chunk=65536):
+    """Appends records (RECORD_DTYPE) to an open CSV file, formatting a chunk per call."""
+    rows = value_columns(records)
+    for i in range(0, len(rows), chunk):
+        part = rows[i:i + chunk]
+        csv_file.write((CSV_ROW * len(part)) % tuple(part.ravel().tolist()))
+
+def decode_sensor_file(input_filename, key=None, lo=None, hi=None):
+    """
+    Decodes a session (.bin, or .lz archive) into CSV. With key ('counter'
+    or 'timestamp') only records in [lo, hi] are written; the session's .idx
+    file, if present, is used to read just that slice of the binary.
+    """
     if not os.path.exists(input_filename):
         print(f"Error: File '{input_filename}' not found.")
         return
@@ -41,42 +180,64 @@ def decode_sensor_file(input_filename):
     # 2. Construct output path: Directory + original filename + .csv
     base_name = os.path.basename(input_filename) # Extract filename from path
     file_no_ext = os.path.splitext(base_name)[0]
+    if key is not None:
+        file_no_ext += f"_{key}_{lo}_{hi}"
     output_filename = os.path.join(OUTPUT_DIR, file_no_ext + ".csv")
 
     print(f"Scanning {input_filename} for valid packets...")
 
     with open(input_filename, 'rb') as f:
-        raw_data = f.read()
+        archived = is_archive(f.read(2))
+        f.seek(0)
+        if key is None or archived:
+            raw_data = f.read()
+            if archived:
+                raw_data = decompress_archive(raw_data)
+            if key is not None:
+                # Index offsets refer to the decompressed session
+                start, end = slice_bounds(load_index(input_filename), key, lo, hi, len(raw_data))
+                raw_data = raw_data[start:end]
+        else:
+            start, end = slice_bounds(load_index(input_filename), key, lo, hi, os.path.getsize(input_filename))
+            print(f"Reading bytes {start}-{end} for {key} range [{lo}, {hi}]")
+            f.seek(start)
+            raw_data = f.read(end - start)
+
+    write_csv(raw_data, output_filename, key, lo, hi)
+
+def write_csv(raw_data, output_filename, key=None, lo=None, hi=None):
+    """
+    Writes the valid records of raw_data (optionally only those with key in
+    [lo, hi]) as CSV, plus a typed .arrow copy when pyarrow is installed.
+    """
+    records, _ = decode_array(raw_data)
+    if key is not None:
+        values = records['Counter' if key == 'counter' else 'Timestamp_ms']
+        records = records[(values >= lo) & (values <= hi)]
 
-    records_saved = 0
     with open(output_filename, 'w') as csv_file:
-        csv_file.write("Counter,Timestamp_ms,SPS30_Particles,SPS30_Conc,PMSA_Particles,PMSA_Conc,PM2012_Particles,PM2012_Conc_GRIMM,PM2012_Conc_TSI,PM2016_Particles,PM2016_Conc\n")
-        
-        i = 0
-        # Scan through the raw bytes one by one
-        while i <= len(raw_data) - PACKET_SIZE:
-            # Look for the Header 'OA'
-            if raw_data[i:i+2] == HEADER:
-                # Potential packet found, extract the full 20-byte block
-                potential_packet = raw_data[i : i + PACKET_SIZE]
-                
-                try:
-                    # Unpack the block
-                    header, count, ts, s1_p, s1_c, s2_p, s2_c, s3_p, s3_c_grimm, s3_c_tsi, s4_p, s4_c, t1, t2 = struct.unpack(PACKET_FORMAT, potential_packet)
-                    print(f"whole packet: {potential_packet.hex()}")
-                    # Verify the Terminator (0xAA, 0xBB)
-                    if (t1, t2) == FOOTER:
-                        csv_file.write(f"{count},{ts},{s1_p},{s1_c},{s2_p},{s2_c},{s3_p},{s3_c_grimm},{s3_c_tsi},{s4_p},{s4_c},\n")
-                        records_saved += 1
-                        i += PACKET_SIZE  # Valid packet, skip ahead 20 bytes
-                        continue
-                except struct.error:
-                    pass
-            
-            # If not a valid packet, move forward by only 1 byte to keep searching
-            i += 1
+        csv_file.write(CSV_HEADER)
+        write_csv_rows(csv_file, records)
 
-    print(f"Finished! Successfully decoded {records_saved} valid records into '{output_filename}'.")
+    if arrow_export.available():
+        arrow_export.write_arrow(records, arrow_export.arrow_path(output_filename))
+    events = write_events(decode_events(raw_data)[0], output_filename) if key is None else 0
+    if events:
+        print(f"  {events} events written to '{events_path(output_filename)}'.")
+    print(f"Finished! Successfully decoded {len(records)} valid records into '{output_filename}'.")
+    return len(records)
+
+def decode_session_data(name, raw_data):
+    """Decodes a session already in memory (e.g. read from a LittleFS image) into OUTPUT_DIR/<name>.csv."""
+    if not os.path.exists(OUTPUT_DIR):
+        os.makedirs(OUTPUT_DIR)
+        print(f"Created directory: {OUTPUT_DIR}")
+
+    if is_archive(raw_data[:2]):
+        raw_data = decompress_archive(raw_data)
+    output_filename = os.path.join(OUTPUT_DIR, os.path.splitext(name)[0] + ".csv")
+    write_csv(raw_data, output_filename)
+    return output_filename
 
 if __name__ == "__main__":
 
@@ -89,9 +250,16 @@ if __name__ == "__main__":
 
     parser = argparse.ArgumentParser(description='Robust Binary Decoder for ESP32-C3')
     parser.add_argument('filename', help='The binary log file to process')
+    parser.add_argument('--counter', nargs=2, type=int, metavar=('FROM', 'TO'), help='Only decode records with counter in [FROM, TO]')
+    parser.add_argument('--time', nargs=2, type=int, metavar=('FROM', 'TO'), help='Only decode records with timestamp [ms] in [FROM, TO]')
     args = parser.parse_args()
     
-    decode_sensor_file(args.filename)
+    if args.counter:
+        decode_sensor_file(args.filename, 'counter', *args.counter)
+    elif args.time:
+        decode_sensor_file(args.filename, 'timestamp', *args.time)
+    else:
+        decode_sensor_file(args.filename)
 
 # import struct
 # import argparse
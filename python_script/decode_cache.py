@@ -0,0 +1,126 @@
+import hashlib
+import json
+import os
+import subprocess
+from concurrent.futures import ProcessPoolExecutor
+from convert_bin_ascii import CSV_HEADER, PACKET_SIZE, HEADER, FOOTER, decode_array, write_csv_rows, \
+    EVENT_HEADER, decode_events, write_events
+from lzss import is_archive, decompress_archive
+import arrow_export
+
+# Incremental decoding: a manifest in the output folder remembers, for every
+# session decoded so far, its size, the SHA-256 of its content and how far
+# the decoder got (end of the last complete record):
+#   {"pmLogs3.bin": {"size": 4140, "sha256": "...", "consumed": 4140}}
+# Sessions are append-only, so a session whose first 'size' bytes still hash
+# the same only needs its new tail decoded and appended to the CSV. Unchanged
+# sessions are skipped, anything else (rewritten sessions, reused names,
+# archives) is decoded from scratch.
+MANIFEST_NAME = "manifest.json"
+
+def load_manifest(output_dir):
+    path = os.path.join(output_dir, MANIFEST_NAME)
+    if not os.path.exists(path):
+        return {}
+    with open(path) as f:
+        return json.load(f)
+
+def save_manifest(output_dir, manifest):
+    path = os.path.join(output_dir, MANIFEST_NAME)
+    with open(path + ".tmp", 'w') as f:
+        json.dump(manifest, f, indent=1)
+    os.replace(path + ".tmp", path)
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()
+
+def csv_path(output_dir, name):
+    return os.path.join(output_dir, os.path.splitext(name)[0] + ".csv")
+
+def plan_session(name, data, entry, output_dir):
+    """Returns ('skip' | 'tail' | 'full', first byte to decode)."""
+    output = csv_path(output_dir, name)
+    if entry is None or not os.path.exists(output):
+        return 'full', 0
+    if arrow_export.available() and not os.path.exists(arrow_export.arrow_path(output)):
+        return 'full', 0
+    if entry['size'] == len(data) and entry['sha256'] == content_hash(data):
+        return 'skip', 0
+    if not is_archive(data[:2]) and len(data) > entry['size'] and \
+            entry['sha256'] == content_hash(data[:entry['size']]):
+        return 'tail', entry['consumed']
+    return 'full', 0
+
+def last_record_end(data, header=HEADER):
+    """End of the last complete record in data, found from the back (0 if there is none)."""
+    i = data.rfind(header, 0, len(data) - PACKET_SIZE + 2)
+    while i >= 0:
+        if tuple(data[i + PACKET_SIZE - 2:i + PACKET_SIZE]) == FOOTER:
+            return i + PACKET_SIZE
+        i = data.rfind(header, 0, i + 1) if i > 0 else -1
+    return 0
+
+def decode_job(data, start, output_path):
+    """Decodes data[start:] into output_path (appending when start > 0). Returns the new 'consumed'."""
+    if is_archive(data[:2]):
+        data = decompress_archive(data)
+
+    records, consumed = decode_array(data, start)
+    with open(output_path, 'a' if start else 'w') as csv_file:
+        if not start:
+            csv_file.write(CSV_HEADER)
+        write_csv_rows(csv_file, records)
+
+    if arrow_export.available():
+        arrow_export.write_arrow(records, arrow_export.arrow_path(output_path), append=start > 0)
+    events, events_end = decode_events(data, start)
+    write_events(events, output_path, append=start > 0)
+    return max(consumed, events_end)
+
+def decode_sessions(sessions, output_dir, jobs=None, oalog=None):
+    """
+    Brings output_dir up to date with sessions, a list of (name, data, path).
+    New and rewritten sessions are decoded in full, grown ones only from
+    where the last run stopped; the decodes run in 'jobs' processes. If the
+    native decoder 'oalog' is given, plain sessions that exist as files
+    ('path' set) and need a full decode are handed to it in one call.
+    Returns the list of CSV files that were written.
+    """
+    os.makedirs(output_dir, exist_ok=True)
+    manifest = load_manifest(output_dir)
+
+    full, tails = [], []
+    for name, data, path in sessions:
+        action, start = plan_session(name, data, manifest.get(name), output_dir)
+        if action == 'skip':
+            print(f"  Unchanged: {name}")
+            continue
+        print(f"  {'Appending' if action == 'tail' else 'Decoding'}: {name} ({len(data) - start} bytes)")
+        (tails if action == 'tail' else full).append((name, data, path, start))
+
+    written = []
+    native = [s for s in full if oalog and s[2] and not is_archive(s[1][:2])]
+    if native:
+        result = subprocess.run([oalog, *[s[2] for s in native], "--csv-dir", output_dir])
+        if result.returncode == 0:
+            for name, data, _, _ in native:
+                # oalog only decodes the sensor records, events are picked up here
+                consumed = max(last_record_end(data), last_record_end(data, EVENT_HEADER))
+                manifest[name] = {'size': len(data), 'sha256': content_hash(data), 'consumed': consumed}
+                written.append(csv_path(output_dir, name))
+                write_events(decode_events(data)[0], csv_path(output_dir, name))
+                if arrow_export.available():
+                    arrow_export.csv_to_arrow(csv_path(output_dir, name))
+            done = {s[0] for s in native}
+            full = [s for s in full if s[0] not in done]
+
+    pending = full + tails
+    with ProcessPoolExecutor(max_workers=jobs) as pool:
+        futures = [(name, data, pool.submit(decode_job, data, start, csv_path(output_dir, name)))
+                   for name, data, _, start in pending]
+        for name, data, future in futures:
+            manifest[name] = {'size': len(data), 'sha256': content_hash(data), 'consumed': future.result()}
+            written.append(csv_path(output_dir, name))
+
+    save_manifest(output_dir, manifest)
+    return written
@@ -0,0 +1,277 @@
+import argparse
+import csv
+import heapq
+import os
+import warnings
+from itertools import islice
+import numpy as np
+from record_stream import iter_chunks, VALUE_FIELDS
+from alignment import GridResampler, Timeline
+from response_analyzer import SENSORS, SIGNALS, nanmedian
+
+# Merges the sessions of several units that ran side by side into one stream
+# on a common clock. Every unit timestamps with its own millis() since boot,
+# so each device's clock is mapped onto the first (reference) device's:
+#   t_ref = t + offset + drift * t        (t: the device's unwrapped Timestamp_ms)
+# The mapping comes from shared markers if a markers file is given, otherwise
+# from the PM signal all units saw:
+#  1. coarse offset: normalized cross-correlation of the whole sessions,
+#     decimated to 'coarse' seconds, over every possible offset
+#  2. offset and drift: per segment of the device's session the lag around the
+#     coarse offset on the full grid, then a straight line through the lags
+# Both passes stream the sessions: pass 1 keeps one value per grid step and
+# device, pass 2 k-way merges the records (heapq.merge), one chunk per device
+# in memory.
+#
+# MARKERS file (CSV, one row per marker seen by a device):
+# Device,Marker,Timestamp_ms     e.g.  unitB,door,1234567
+# Markers with the same name are the same moment on every device.
+OUTPUT_FILE = "./merged.csv"
+MERGED_FIELDS = ["Time_ms", "Device"] + VALUE_FIELDS
+CLOCK_FIELDS = ["device", "file", "method", "offset_ms", "drift_ppm", "points", "correlation"]
+
+def masked_xcorr(ref, dev, min_overlap):
+    """
+    Normalized cross-correlation of two series with gaps (NaN), for every lag k
+    with dev[j] matched to ref[j + k]. Returns (lags, correlation); lags that
+    overlap on fewer than min_overlap valid samples are NaN.
+    """
+    n = 1 << int(np.ceil(np.log2(len(ref) + len(dev))))
+    ref_valid, dev_valid = ~np.isnan(ref), ~np.isnan(dev)
+    r = np.where(ref_valid, ref - np.nanmean(ref), 0.0)
+    d = np.where(dev_valid, dev - np.nanmean(dev), 0.0)
+
+    def corr(x, y):
+        # sum_j y[j] * x[j + k]
+        return np.fft.irfft(np.conj(np.fft.rfft(y, n)) * np.fft.rfft(x, n), n)
+
+    lags = np.concatenate([np.arange(0, len(ref)), np.arange(-(len(dev) - 1), 0)])
+    index = lags % n
+    numerator = corr(r, d)[index]
+    energy = corr(r * r, dev_valid.astype(float))[index] * corr(ref_valid.astype(float), d * d)[index]
+    count = corr(ref_valid.astype(float), dev_valid.astype(float))[index]
+    with np.errstate(invalid='ignore', divide='ignore'):
+        correlation = numerator / np.sqrt(energy)
+    correlation[(count < min_overlap - 0.5) | (energy <= 1e-9)] = np.nan
+    return lags, correlation
+
+def peak(lags, correlation):
+    """Lag of the correlation maximum, refined between samples by a parabola (None if there is none)."""
+    if np.all(np.isnan(correlation)):
+        return None, np.nan
+    best = int(np.nanargmax(correlation))
+    lag = float(lags[best])
+    if 0 < best < len(lags) - 1 and lags[best - 1] == lags[best] - 1 and lags[best + 1] == lags[best] + 1:
+        a, b, c = correlation[best - 1], correlation[best], correlation[best + 1]
+        if not (np.isnan(a) or np.isnan(c)) and a - 2 * b + c < 0:
+            lag += 0.5 * (a - c) / (a - 2 * b + c)
+    return lag, float(correlation[best])
+
+class DeviceSeries:
+    """One device's combined PM signal on a uniform grid (median over its sensors), built in one pass."""
+
+    def __init__(self, path, signal="pm25", dt=1.0, max_gap=5.0):
+        columns = [SENSORS[name][SIGNALS.index(signal)] for name in SENSORS]
+        resampler = GridResampler(columns, dt=dt, method="linear", max_gap=max_gap)
+        blocks = []
+        self.start = self.end = None    # [ms] first/last record on the unwrapped timeline
+        for chunk in iter_chunks(path):
+            if len(chunk["Timestamp_ms"]) == 0:
+                continue
+            _, matrix = resampler.feed(chunk)
+            blocks.append(nanmedian(matrix, axis=1).astype(np.float32))
+            if self.start is None:
+                self.start = resampler.t0
+            self.end = resampler.timeline.time_last
+        self.t0 = resampler.t0          # [ms] time of values[0]
+        self.dt_ms = dt * 1000.0
+        self.values = np.concatenate(blocks).astype(np.float64) if blocks else np.zeros(0)
+
+    def unwrap_marker(self, raw):
+        """A logged marker time on this device's unwrapped timeline (nearest wrap)."""
+        middle = (self.start + self.end) / 2
+        return raw + round((middle - raw) / (1 << 32)) * (1 << 32)
+
+class ClockModel:
+    def __init__(self, method, offset=0.0, drift=0.0, points=0, correlation=np.nan):
+        self.method = method
+        self.offset = offset        # [ms]
+        self.drift = drift          # [ms/ms]
+        self.points = points
+        self.correlation = correlation
+
+    def apply(self, times):
+        return times + self.offset + self.drift * times
+
+def fit_line(t, offsets, tolerance):
+    """Least-squares offset + drift * t through the points, dropping outliers once."""
+    t, offsets = np.asarray(t, dtype=float), np.asarray(offsets, dtype=float)
+    if len(t) == 1 or np.ptp(t) == 0:
+        return float(np.median(offsets)), 0.0, len(t)
+    drift, offset = np.polyfit(t, offsets, 1)
+    keep = np.abs(offsets - (offset + drift * t)) <= max(tolerance, 3 * np.median(np.abs(offsets - (offset + drift * t))))
+    if 2 <= keep.sum() < len(t) and np.ptp(t[keep]) > 0:
+        drift, offset = np.polyfit(t[keep], offsets[keep], 1)
+    return float(offset), float(drift), int(keep.sum())
+
+def estimate_xcorr(ref, dev, coarse=10.0, segment=1800.0, search=60.0, min_overlap=600.0, min_correlation=0.5):
+    """Clock model of 'dev' relative to 'ref' (DeviceSeries on the same grid) from their PM signals."""
+    if len(ref.values) == 0 or len(dev.values) == 0:
+        return None
+    dt = ref.dt_ms / 1000.0
+
+    # 1. Coarse offset over every possible lag
+    factor = max(1, int(round(coarse / dt)))
+    def decimate(values):
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore", RuntimeWarning)     # Blocks without any reading
+            return np.nanmean(values[:len(values) // factor * factor].reshape(-1, factor), axis=1)
+    r, d = decimate(ref.values), decimate(dev.values)
+    if len(r) < 2 or len(d) < 2:
+        return None
+    lag, correlation = peak(*masked_xcorr(r, d, min_overlap / coarse))
+    if lag is None or correlation < min_correlation:
+        return None
+    expected = int(round(lag * factor))     # [grid samples] dev[j] ~ ref[j + expected]
+
+    # 2. Lag per segment around it
+    seg, reach = int(round(segment / dt)), int(round(search / dt))
+    times, offsets, scores = [], [], []
+    for a in range(0, len(dev.values) - seg // 2, seg):
+        part = dev.values[a:a + seg]
+        lo = max(0, a + expected - reach)
+        hi = min(len(ref.values), a + expected + len(part) + reach)
+        if hi - lo < len(part) // 2:
+            continue
+        lags, cc = masked_xcorr(ref.values[lo:hi], part, min(len(part), min_overlap / dt) / 2)
+        lags = lags + lo - a
+        window = np.abs(lags - expected) <= reach
+        lag_s, score = peak(lags[window], cc[window])
+        if lag_s is None or score < min_correlation:
+            continue
+        times.append(dev.t0 + (a + len(part) / 2) * dev.dt_ms)
+        offsets.append(ref.t0 - dev.t0 + lag_s * dev.dt_ms)
+        scores.append(score)
+
+    if not times:
+        return ClockModel("xcorr", ref.t0 - dev.t0 + expected * dev.dt_ms, 0.0, 1, correlation)
+    offset, drift, points = fit_line(times, offsets, tolerance=2 * dev.dt_ms)
+    return ClockModel("xcorr", offset, drift, points, float(np.median(scores)))
+
+def estimate_markers(ref, dev, ref_markers, dev_markers):
+    """Clock model from the markers both devices logged, None if they share none."""
+    shared = sorted(set(ref_markers) & set(dev_markers))
+    if not shared:
+        return None
+    t = [dev.unwrap_marker(dev_markers[m]) for m in shared]
+    offsets = [ref.unwrap_marker(ref_markers[m]) - tm for m, tm in zip(shared, t)]
+    offset, drift, points = fit_line(t, offsets, tolerance=1000.0)
+    return ClockModel("markers", offset, drift, points)
+
+def load_markers(path):
+    markers = {}
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            markers.setdefault(row["Device"], {})[row["Marker"]] = int(row["Timestamp_ms"])
+    return markers
+
+def device_labels(paths):
+    """'label=path' arguments or file names; folder names when file names repeat (synced/<device>/...)."""
+    labels, files = [], []
+    for arg in paths:
+        label, sep, path = arg.partition("=")
+        if not sep:
+            label, path = None, arg
+        labels.append(label)
+        files.append(path)
+    stems = [os.path.splitext(os.path.basename(p))[0] for p in files]
+    for i, p in enumerate(files):
+        if labels[i] is None:
+            unique = stems.count(stems[i]) == 1
+            labels[i] = stems[i] if unique else os.path.basename(os.path.dirname(os.path.abspath(p))) or f"dev{i}"
+    return labels, files
+
+def corrected_records(index, label, path, model, restart_gap):
+    """Records of one device as merge rows (corrected time first), chunk by chunk."""
+    timeline = Timeline(restart_gap)
+    for chunk in iter_chunks(path):
+        if len(chunk["Timestamp_ms"]) == 0:
+            continue
+        times, _ = timeline.unwrap(chunk["Timestamp_ms"].astype(np.int64))
+        corrected = np.rint(model.apply(times.astype(np.float64))).astype(np.int64).tolist()
+        columns = [chunk[name].tolist() for name in VALUE_FIELDS]
+        for row in zip(corrected, *columns):
+            yield (row[0], index, label) + row[1:]
+
+def merge_devices(paths, output=OUTPUT_FILE, markers=None, signal="pm25", dt=1.0, max_gap=5.0, **options):
+    """
+    Estimates the clock of every device relative to the first one and writes
+    all records, ordered on that clock, to 'output'. Returns the clock models.
+    """
+    labels, files = device_labels(paths)
+    marker_table = load_markers(markers) if markers else {}
+
+    print("Pass 1: clock estimation")
+    series = [DeviceSeries(path, signal, dt, max_gap) for path in files]
+    models = [ClockModel("reference")]
+    for label, dev in zip(labels[1:], series[1:]):
+        model = None
+        if label in marker_table and labels[0] in marker_table:
+            model = estimate_markers(series[0], dev, marker_table[labels[0]], marker_table[label])
+        if model is None:
+            model = estimate_xcorr(series[0], dev, **options)
+        if model is None:
+            print(f"  Warning: no common signal with {labels[0]} found for {label}, keeping its own clock")
+            model = ClockModel("none")
+        models.append(model)
+        print(f"  {label:>12s}: offset {model.offset / 1000.0:+.3f} s, drift {model.drift * 1e6:+.1f} ppm "
+              f"({model.method}, {model.points} points)")
+
+    print("Pass 2: merging")
+    restart_gap = max_gap * 1000.0 + dt * 1000.0     # Same timeline as the estimation pass
+    streams = [corrected_records(i, label, path, model, restart_gap)
+               for i, (label, path, model) in enumerate(zip(labels, files, models))]
+    rows = 0
+    with open(output, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(MERGED_FIELDS)
+        merged = heapq.merge(*streams, key=lambda row: (row[0], row[1]))
+        while True:
+            batch = [row[:1] + row[2:] for row in islice(merged, 65536)]
+            if not batch:
+                break
+            writer.writerows(batch)
+            rows += len(batch)
+
+    clock_path = os.path.splitext(output)[0] + "_clocks.csv"
+    with open(clock_path, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(CLOCK_FIELDS)
+        for label, path, model in zip(labels, files, models):
+            writer.writerow([label, path, model.method, round(model.offset, 1), round(model.drift * 1e6, 3),
+                             model.points, round(model.correlation, 4) if not np.isnan(model.correlation) else ""])
+    print(f"Finished! {rows} records of {len(files)} devices written to '{output}', clocks in '{clock_path}'.")
+    return models
+
+def main():
+    parser = argparse.ArgumentParser(description='Merge the sessions of several devices onto one clock')
+    parser.add_argument('files', nargs='+', help='One session per device (.bin, .lz, .csv or .arrow), optionally label=path; '
+                                                 'the first one is the reference clock')
+    parser.add_argument('--output', default=OUTPUT_FILE)
+    parser.add_argument('--markers', help='CSV of shared markers (Device,Marker,Timestamp_ms)')
+    parser.add_argument('--signal', choices=SIGNALS, default="pm25", help='Common signal for the cross-correlation')
+    parser.add_argument('--dt', type=float, default=1.0, help='Grid spacing of the signal [s]')
+    parser.add_argument('--segment', type=float, default=1800.0, help='Segment length for the drift estimate [s]')
+    parser.add_argument('--search', type=float, default=60.0, help='Lag searched per segment around the coarse offset [s]')
+    args = parser.parse_args()
+
+    for arg in args.files:
+        path = arg.partition("=")[2] or arg
+        if not os.path.exists(path):
+            print(f"Error: File '{path}' not found.")
+            return
+    merge_devices(args.files, args.output, markers=args.markers, signal=args.signal, dt=args.dt,
+                  segment=args.segment, search=args.search)
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,6 @@
 import esptool
 import sys
+import argparse
 import serial.tools.list_ports
 
 def get_esp_port():
@@ -27,25 +28,109 @@ def get_esp_port():
         sys.exit(1)
 
 # Configuration from your partition table
-PORT = get_esp_port() #'/dev/cu.usbmodem21201'
 BAUD = 460800   #115200, 460800
 START_OFFSET = '0x270000'   # Start of LittleFS
 SIZE_HEX = '0x180000'       # Size of LittleFS (1.5MB)
 OUTPUT_FILE = './output_folder/littlefs_raw.bin'
 
-# Updated command for esptool
-cmd_args = [
-    '--port', PORT,
-    '--baud', str(BAUD), 
-    'read-flash', 
-    START_OFFSET, 
-    SIZE_HEX, 
-    OUTPUT_FILE]
-
-print(f"Attempting to extract LittleFS from {START_OFFSET}...")
-
-try:
-    esptool.main(cmd_args)
-    print(f"Success! Data saved to {OUTPUT_FILE}")
-except Exception as e:
-    print(f"Error: {e}")
\ No newline at end of file
+def read_block_map(port):
+    """
+    Asks the running firmware which blocks of the log partition hold data.
+    Returns (partition address, block size, [used flag per block]).
+    """
+    from sync_logs import open_port, send_command, read_reply
+
+    ser = open_port(port)
+    try:
+        send_command(ser, "blocks")
+        reply = read_reply(ser, "BLOCKS ")
+    finally:
+        ser.close()
+    if not reply:
+        print("❌ Device did not answer. Is the OpenAir firmware running?")
+        sys.exit(1)
+
+    address, block_size, count, bitmap = reply[0].split()
+    bitmap = bytes.fromhex(bitmap)
+    used = [bool(bitmap[i // 8] & (1 << (i % 8))) for i in range(int(count))]
+    return int(address, 16), int(block_size), used
+
+def used_runs(used):
+    """[(first block, number of blocks)] of consecutive used blocks."""
+    runs = []
+    for i, flag in enumerate(used):
+        if not flag:
+            continue
+        if runs and runs[-1][0] + runs[-1][1] == i:
+            runs[-1] = (runs[-1][0], runs[-1][1] + 1)
+        else:
+            runs.append((i, 1))
+    return runs
+
+def extract_sparse(port):
+    """
+    Reads only the used blocks of the log partition over one esptool
+    connection and fills the rest with 0xFF (erased flash), which gives the
+    same image as a full read-flash of the partition.
+    The firmware only knows which blocks are erased, not which hold live
+    files: littlefs leaves the blocks of removed files as they are, so on a
+    device that has rotated or archived sessions most blocks show as used
+    and this is barely faster than a full read.
+    """
+    from esptool.cmds import detect_chip
+
+    address, block_size, used = read_block_map(port)
+    runs = used_runs(used)
+    used_blocks = sum(n for _, n in runs)
+    print(f"{used_blocks}/{len(used)} blocks in use, {len(runs)} ranges to read")
+    if used_blocks > len(used) * 3 // 4:
+        print("⚠️  Most blocks are not erased (removed files keep their blocks), a full read would be about as fast")
+
+    image = bytearray(b'\xff' * (len(used) * block_size))
+    esp = detect_chip(port)
+    try:
+        esp = esp.run_stub()
+        esp.change_baud(BAUD)
+        for first, n in runs:
+            print(f"Reading 0x{address + first * block_size:x} (+0x{n * block_size:x})...")
+            image[first * block_size:(first + n) * block_size] = esp.read_flash(address + first * block_size, n * block_size)
+    finally:
+        esp.hard_reset()
+        esp._port.close()
+
+    with open(OUTPUT_FILE, 'wb') as f:
+        f.write(image)
+    print(f"Success! {used_blocks * block_size} of {len(image)} bytes read, image saved to {OUTPUT_FILE}")
+
+def main():
+    parser = argparse.ArgumentParser(description='Read the LittleFS log partition of the ESP32-C3')
+    parser.add_argument('--sparse', action='store_true',
+                        help='Only read the blocks that are not erased (needs the OpenAir firmware running) and fill the rest with 0xFF; '
+                             'blocks of removed files still count, so this helps most on a young partition')
+    args = parser.parse_args()
+
+    PORT = get_esp_port() #'/dev/cu.usbmodem21201'
+
+    if args.sparse:
+        extract_sparse(PORT)
+        return
+
+    # Updated command for esptool
+    cmd_args = [
+        '--port', PORT,
+        '--baud', str(BAUD), 
+        'read-flash', 
+        START_OFFSET, 
+        SIZE_HEX, 
+        OUTPUT_FILE]
+
+    print(f"Attempting to extract LittleFS from {START_OFFSET}...")
+
+    try:
+        esptool.main(cmd_args)
+        print(f"Success! Data saved to {OUTPUT_FILE}")
+    except Exception as e:
+        print(f"Error: {e}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,51 @@
+import os
+from littlefs import LittleFS
+
+# Geometry of the log partition (see partitions.csv and the mklittlefs call
+# this module replaces: -b 4096 -p 256 -s 0x180000)
+BLOCK_SIZE = 4096
+PAGE_SIZE = 256
+IMAGE_SIZE = 0x180000
+LFS_TYPE_REG = 0x001    # lfs.h: regular file
+
+def mount_image(raw_image):
+    """
+    Mounts a LittleFS partition dump (bytes) in memory, using the
+    littlefs C core through littlefs-python. Nothing is written to disk.
+    """
+    if len(raw_image) % BLOCK_SIZE:
+        raise ValueError(f"Image size {len(raw_image)} is not a multiple of {BLOCK_SIZE} bytes")
+
+    fs = LittleFS(block_size=BLOCK_SIZE, block_count=len(raw_image) // BLOCK_SIZE,
+                  read_size=PAGE_SIZE, prog_size=PAGE_SIZE, mount=False)
+    fs.context.buffer = bytearray(raw_image)
+    fs.mount()
+    return fs
+
+def list_files(fs):
+    """Returns [(name, size)] of every file in the image root, sorted by name."""
+    return sorted((st.name, st.size) for st in fs.scandir("/") if st.type == LFS_TYPE_REG)
+
+def read_file(fs, name):
+    """Returns the content of /<name> in the image."""
+    with fs.open("/" + name, "rb") as f:
+        return f.read()
+
+def sessions(fs):
+    """
+    Yields (name, data) for every session in the image that should be decoded:
+    .bin logs, and .lz archives whose .bin is gone. Indexes (.idx) are skipped.
+    """
+    names = {name for name, _ in list_files(fs)}
+    for name in sorted(names):
+        stem, ext = os.path.splitext(name)
+        if ext == ".idx":
+            continue
+        if ext == ".lz" and stem + ".bin" in names:
+            continue
+        yield name, read_file(fs, name)
+
+def load_image(image_path):
+    """Reads and mounts a partition dump from disk."""
+    with open(image_path, "rb") as f:
+        return mount_image(f.read())
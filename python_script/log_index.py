@@ -0,0 +1,46 @@
+import struct
+import os
+
+# INDEX_FORMAT Breakdown (matches LogIndexEntry in OpenAirMultiSense.h):
+# <  : Little-endian
+# I  : uint32_t (Counter of the indexed record)
+# I  : uint32_t (Timestamp [ms])
+# I  : uint32_t (Byte offset of the record in the .bin file)
+# Total Size: 12 bytes
+INDEX_FORMAT = '<III'
+INDEX_SIZE = struct.calcsize(INDEX_FORMAT)
+
+def index_path(bin_path):
+    """pmLogs3.bin -> pmLogs3.idx"""
+    return os.path.splitext(bin_path)[0] + ".idx"
+
+def load_index(bin_path):
+    """Returns the list of (counter, timestamp, offset) entries, or [] if the session has no index."""
+    path = index_path(bin_path)
+    if not os.path.exists(path):
+        return []
+
+    with open(path, 'rb') as f:
+        raw = f.read()
+
+    usable = len(raw) - len(raw) % INDEX_SIZE
+    return list(struct.iter_unpack(INDEX_FORMAT, raw[:usable]))
+
+def slice_bounds(index, key, lo, hi, file_size):
+    """
+    Byte range [start, end) of the session that holds every record whose
+    key ('counter' or 'timestamp') lies in [lo, hi].
+    Records are appended in order, so the range is bounded by the last
+    entry at or before 'lo' and the first entry after 'hi'.
+    """
+    col = 0 if key == 'counter' else 1
+    start, end = 0, file_size
+
+    for entry in index:
+        if entry[col] <= lo:
+            start = entry[2]
+        if entry[col] > hi:
+            end = entry[2]
+            break
+
+    return start, end
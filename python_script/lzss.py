@@ -0,0 +1,65 @@
+import struct
+
+# Matches lib/lzss/lzss.h
+# LZSS_HEADER_FORMAT Breakdown ("pmLogsN.lz" archive header):
+# <  : Little-endian
+# 2s : char[2] (Magic 'OZ')
+# B  : uint8_t (Window bits)
+# B  : uint8_t (Length bits)
+# B  : uint8_t (Delta stride, 0 = no delta filter)
+# I  : uint32_t (Uncompressed size)
+LZSS_HEADER_FORMAT = '<2sBBBI'
+LZSS_HEADER_SIZE = struct.calcsize(LZSS_HEADER_FORMAT)
+LZSS_MAGIC = b'OZ'
+LZSS_MIN_MATCH = 3
+
+def undelta(data, stride):
+    """Reverses the encoder's delta filter: each byte was stored minus the byte 'stride' earlier."""
+    out = bytearray(data)
+    for i in range(stride, len(out)):
+        out[i] = (out[i] + out[i - stride]) & 0xFF
+    return bytes(out)
+
+def decompress(data, window_bits=8, length_bits=4, size=None, stride=0):
+    """Decodes an LZSS bitstream; stops at 'size' bytes or when the padding is reached."""
+    out = bytearray()
+    total_bits = len(data) * 8
+    ref_bits = 1 + window_bits + length_bits
+    bit = 0
+
+    def take(pos, count):
+        # A token field never spans more than 3 bytes (count <= 16)
+        byte = pos >> 3
+        chunk = int.from_bytes(data[byte:byte + 3].ljust(3, b'\0'), 'big')
+        return (chunk >> (24 - (pos & 7) - count)) & ((1 << count) - 1)
+
+    while size is None or len(out) < size:
+        if total_bits - bit < 9:
+            break
+        if take(bit, 1):
+            out.append(take(bit + 1, 8))
+            bit += 9
+            continue
+        if total_bits - bit < ref_bits:
+            break
+        dist = take(bit + 1, window_bits) + 1
+        length = take(bit + 1 + window_bits, length_bits) + LZSS_MIN_MATCH
+        bit += ref_bits
+        start = len(out) - dist
+        if start < 0:
+            raise ValueError("LZSS back-reference before start of stream")
+        for k in range(length):     # May overlap the bytes it produces
+            out.append(out[start + k])
+
+    out = bytes(out if size is None else out[:size])
+    return undelta(out, stride) if stride else out
+
+def is_archive(raw):
+    return raw[:2] == LZSS_MAGIC
+
+def decompress_archive(raw):
+    """Returns the original session bytes of a "pmLogsN.lz" archive."""
+    magic, window_bits, length_bits, stride, size = struct.unpack(LZSS_HEADER_FORMAT, raw[:LZSS_HEADER_SIZE])
+    if magic != LZSS_MAGIC:
+        raise ValueError("Not an LZSS archive")
+    return decompress(raw[LZSS_HEADER_SIZE:], window_bits, length_bits, size, stride)
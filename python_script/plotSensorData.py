@@ -1,10 +1,12 @@
-import struct
 import pandas as pd
 import matplotlib.pyplot as plt
 import matplotlib.ticker as ticker
 import numpy as np  
 import sys
 import os
+import arrow_export
+from convert_bin_ascii import decode_array, VALUE_FIELDS
+from lzss import is_archive, decompress_archive
 
 def plot_data(file_path):
     # ========================================================
@@ -40,41 +42,38 @@ def plot_data(file_path):
         return
 
     ext = os.path.splitext(file_path)[1].lower()
-    
+    column_map = {
+        'SPS30_Particles': 'S1_P', 'SPS30_Conc': 'S1_C',
+        'PMSA_Particles': 'S2_P', 'PMSA_Conc': 'S2_C',
+        'PM2012_Particles': 'S3_P', 
+        'PM2012_Conc_GRIMM': 'S3_C_Grimm', 'PM2012_Conc_TSI': 'S3_C_TSI',
+        'PM2016_Particles': 'S4_P', 'PM2016_Conc': 'S4_C',
+        'Timestamp_ms': 'Timestamp_ms'
+    }
+
+    # The decoder's typed .arrow copy loads without parsing, prefer it over the CSV
+    arrow_file = arrow_export.arrow_path(file_path)
+    if ext in ('.csv', '.arrow') and os.path.exists(arrow_file) and arrow_export.available():
+        ext = '.arrow'
+
     # 1. Loading and Mapping Data (Fixing CSV shift)
-    if ext == '.csv':
+    if ext == '.arrow':
+        df = arrow_export.read_arrow(arrow_file)
+        df['Timestamp_ms'] = df['Timestamp_ms'].astype(np.int64)
+        df = df.rename(columns=column_map)
+    elif ext == '.csv':
         df = pd.read_csv(file_path, index_col=False)
-        column_map = {
-            'SPS30_Particles': 'S1_P', 'SPS30_Conc': 'S1_C',
-            'PMSA_Particles': 'S2_P', 'PMSA_Conc': 'S2_C',
-            'PM2012_Particles': 'S3_P', 
-            'PM2012_Conc_GRIMM': 'S3_C_Grimm', 'PM2012_Conc_TSI': 'S3_C_TSI',
-            'PM2016_Particles': 'S4_P', 'PM2016_Conc': 'S4_C',
-            'Timestamp_ms': 'Timestamp_ms'
-        }
         df = df.rename(columns=column_map)
     else:
-        records = []
+        # Raw session (.bin) or archive (.lz): decoded in one vectorized pass
         with open(file_path, 'rb') as f:
-            while True:
-                byte = f.read(1)
-                if not byte: break
-                if byte != b'O': continue
-                if f.read(1) != b'A': continue
-                data = f.read(28)
-                if len(data) < 28: break
-                try:
-                    seq, ts = struct.unpack('<II', data[0:8])
-                    vals = struct.unpack('<9H', data[8:26])
-                    records.append({
-                        'Timestamp_ms': ts,
-                        'S1_P': vals[0], 'S1_C': vals[1],
-                        'S2_P': vals[2], 'S2_C': vals[3],
-                        'S3_P': vals[4], 'S3_C_Grimm': vals[5], 'S3_C_TSI': vals[6],
-                        'S4_P': vals[7], 'S4_C': vals[8]
-                    })
-                except: break
-        df = pd.DataFrame(records)
+            raw_data = f.read()
+        if is_archive(raw_data[:2]):
+            raw_data = decompress_archive(raw_data)
+        records, _ = decode_array(raw_data)
+        df = pd.DataFrame({name: records[name] for name in VALUE_FIELDS})
+        df['Timestamp_ms'] = df['Timestamp_ms'].astype(np.int64)
+        df = df.rename(columns=column_map)
 
     if df.empty:
         print("❌ No data found.")
@@ -152,7 +151,7 @@ def plot_data(file_path):
 
 if __name__ == "__main__":
     if len(sys.argv) < 2:
-        print("Usage: python3 plotSensorData.py <data.csv/bin>")
+        print("Usage: python3 plotSensorData.py <data.csv/arrow/bin/lz>")
     else:
         plot_data(sys.argv[1])
 
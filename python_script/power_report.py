@@ -0,0 +1,91 @@
+import argparse
+import csv
+import os
+
+# Battery life of a session from its power events (type 2 in
+# <session>_events.csv, written by convert_bin_ascii.py). Every event holds
+# the time spent active, idle and in light sleep and the estimated MCU charge
+# since boot, so the difference between the first and last event of a boot
+# gives the average current over that stretch. The always-awake figure is
+# the firmware without power management: the CPU at 160 MHz all the time.
+EVENT_POWER = 2
+ALWAYS_AWAKE_MA = 23.0      # CURRENT_ACTIVE_UA in powerManager.h
+REPORT_FIELDS = ["session", "duration_h", "active_pct", "idle_pct", "sleep_pct", "mcu_ma", "total_ma",
+                 "runtime_h", "always_awake_runtime_h", "gain", "max_lateness_ms"]
+
+def read_power_events(path):
+    """(timestamp, source, [active, idle, sleep, charge]) of every power event, in file order."""
+    events = []
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            if int(row["Type"]) == EVENT_POWER:
+                events.append((int(row["Timestamp_ms"]), int(row["Source"]),
+                               [int(row["Data%d" % i]) for i in range(4)]))
+    return events
+
+def boot_spans(events):
+    """Splits the events where the device rebooted (millis() started over)."""
+    spans, span = [], []
+    for event in events:
+        if span and event[0] < span[-1][0]:
+            spans.append(span)
+            span = []
+        span.append(event)
+    if span:
+        spans.append(span)
+    return spans
+
+def report(path, battery_mah, sensors_ma):
+    """One REPORT_FIELDS row over all boots of the session, None without two power events."""
+    times = [0, 0, 0]
+    charge = 0
+    lateness = 0
+    for span in boot_spans(read_power_events(path)):
+        first, last = span[0][2], span[-1][2]
+        for i in range(3):
+            times[i] += last[i] - first[i]
+        charge += last[3] - first[3]
+        lateness = max([lateness] + [e[1] for e in span[1:]])
+    duration_ms = sum(times)
+    if duration_ms == 0:
+        return None
+
+    hours = duration_ms / 3600000.0
+    mcu_ma = charge / 1000.0 / hours
+    total_ma = mcu_ma + sensors_ma
+    awake_ma = ALWAYS_AWAKE_MA + sensors_ma
+    return {
+        "session": os.path.basename(path).replace("_events.csv", ""),
+        "duration_h": round(hours, 3),
+        "active_pct": round(100.0 * times[0] / duration_ms, 1),
+        "idle_pct": round(100.0 * times[1] / duration_ms, 1),
+        "sleep_pct": round(100.0 * times[2] / duration_ms, 1),
+        "mcu_ma": round(mcu_ma, 2),
+        "total_ma": round(total_ma, 2),
+        "runtime_h": round(battery_mah / total_ma, 1),
+        "always_awake_runtime_h": round(battery_mah / awake_ma, 1),
+        "gain": round(awake_ma / total_ma, 2),
+        "max_lateness_ms": lateness,
+    }
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Battery life from the power events of decoded sessions')
+    parser.add_argument('files', nargs='+', help='<session>_events.csv files (decoded_results/)')
+    parser.add_argument('--battery', type=float, default=3000.0, help='Battery capacity [mAh]')
+    parser.add_argument('--sensors', type=float, default=0.0,
+                        help='Current of the sensors and display [mA], the same with and without sleep')
+    parser.add_argument('--output', default=None, help='Also write the table to this CSV')
+    args = parser.parse_args()
+
+    rows = [r for r in (report(path, args.battery, args.sensors) for path in args.files) if r]
+    if not rows:
+        print("No power events found (firmware without power management, or sessions under a minute).")
+    for r in rows:
+        print(f"{r['session']}: {r['duration_h']} h, sleep {r['sleep_pct']} %, MCU {r['mcu_ma']} mA, "
+              f"{r['runtime_h']} h on {args.battery:g} mAh vs {r['always_awake_runtime_h']} h always awake "
+              f"(x{r['gain']}), max sample lateness {r['max_lateness_ms']} ms")
+    if args.output and rows:
+        with open(args.output, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=REPORT_FIELDS)
+            writer.writeheader()
+            writer.writerows(rows)
@@ -0,0 +1,60 @@
+import os
+import numpy as np
+from convert_bin_ascii import decode_array, VALUE_FIELDS, PACKET_SIZE
+from lzss import is_archive, decompress_archive
+
+# Reads decoded sessions in bounded chunks, whatever the format:
+# .bin (raw session or partition image), .lz (archive), .csv or .arrow.
+# Every chunk is a dict {column name: numpy array} with the CSV columns
+# (Counter, Timestamp_ms and the 9 sensor values), in file order.
+INVALID_VALUE = 65535   # Sensor value logged when a reading failed
+SENSOR_FIELDS = VALUE_FIELDS[2:]
+READ_SIZE = 1 << 20     # [bytes] of a .bin read per chunk
+
+def _records_to_chunk(records):
+    return {name: np.ascontiguousarray(records[name]) for name in VALUE_FIELDS}
+
+def _iter_binary(path):
+    with open(path, 'rb') as f:
+        head = f.read(2)
+        f.seek(0)
+        if is_archive(head):
+            # Archives only decompress as a whole; a session is at most the partition size
+            records, _ = decode_array(decompress_archive(f.read()))
+            yield _records_to_chunk(records)
+            return
+
+        carry = b''
+        while True:
+            block = f.read(READ_SIZE)
+            if not block:
+                break
+            raw_data = carry + block
+            records, consumed = decode_array(raw_data)
+            if len(records):
+                yield _records_to_chunk(records)
+            # A packet may straddle the read boundary
+            carry = raw_data[max(consumed, len(raw_data) - PACKET_SIZE + 1):]
+
+def _iter_csv(path, chunk_records):
+    import pandas as pd
+
+    for df in pd.read_csv(path, index_col=False, usecols=VALUE_FIELDS, chunksize=chunk_records):
+        yield {name: df[name].to_numpy() for name in VALUE_FIELDS}
+
+def _iter_arrow(path, chunk_records):
+    import pyarrow as pa
+
+    with pa.memory_map(path) as source:
+        for batch in pa.ipc.open_file(source).read_all().to_batches(max_chunksize=chunk_records):
+            yield {name: batch.column(name).to_numpy() for name in VALUE_FIELDS}
+
+def iter_chunks(path, chunk_records=65536):
+    """Yields the records of a session file in chunks of about chunk_records."""
+    ext = os.path.splitext(path)[1].lower()
+    if ext == '.csv':
+        yield from _iter_csv(path, chunk_records)
+    elif ext == '.arrow':
+        yield from _iter_arrow(path, chunk_records)
+    else:
+        yield from _iter_binary(path)
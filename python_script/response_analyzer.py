@@ -0,0 +1,238 @@
+import argparse
+import csv
+import os
+import warnings
+from itertools import combinations
+import numpy as np
+from record_stream import iter_chunks
+from alignment import GridResampler, METHODS
+
+# Compares how fast the sensors respond to plumes, session by session:
+#  - lags: FFT cross-correlation of every sensor pair over sliding windows,
+#          for PM2.5 concentration and particle counts
+#  - steps: step events found on a reference sensor, with the t10/t50/t90
+#           rise or fall time of every sensor relative to the step onset
+# Records are streamed in chunks onto a uniform time grid (alignment.py) and
+# only the samples still needed by an open window or event are kept in memory.
+SENSORS = {
+    # name: (PM2.5 column, particle count column)
+    "SPS30": ("SPS30_Conc", "SPS30_Particles"),
+    "PMSA003I": ("PMSA_Conc", "PMSA_Particles"),
+    "PM2012": ("PM2012_Conc_GRIMM", "PM2012_Particles"),
+    "PM2016": ("PM2016_Conc", "PM2016_Particles"),
+}
+SIGNALS = ("pm25", "particles")
+OUTPUT_DIR = "./analysis_results"
+
+LAG_FIELDS = ["window_start_s", "window_end_s", "signal", "sensor_a", "sensor_b", "lag_s", "correlation"]
+STEP_FIELDS = ["onset_s", "direction", "signal", "sensor", "baseline", "final", "t10_s", "t50_s", "t90_s"]
+
+def nanmedian(values, axis):
+    """np.nanmedian without the warning for all-NaN slices (sensor offline)."""
+    with warnings.catch_warnings():
+        warnings.simplefilter("ignore", RuntimeWarning)
+        return np.nanmedian(values, axis=axis)
+
+class ResponseAnalyzer:
+    """
+    Feed it record chunks of one session (record_stream.iter_chunks), then
+    call finish(). Results accumulate in 'lags' and 'steps' (lists of dicts
+    with LAG_FIELDS / STEP_FIELDS). A positive lag means sensor_b responds
+    later than sensor_a.
+    """
+
+    def __init__(self, dt=1.0, method="locf", window=600.0, step=300.0, max_lag=60.0, max_gap=5.0,
+                 reference="SPS30", threshold=10.0, smooth=10.0, pre=30.0, post=120.0, settle=30.0,
+                 min_valid=0.8):
+        self.dt = dt
+        self.window = int(round(window / dt))
+        self.step = int(round(step / dt))
+        self.max_lag = int(round(max_lag / dt))
+        self.threshold = threshold
+        self.smooth = max(1, int(round(smooth / dt)))
+        self.pre = int(round(pre / dt))
+        self.post = int(round(post / dt))
+        self.settle = max(1, int(round(settle / dt)))
+        self.min_valid = min_valid
+
+        # Grid channels: every sensor's PM2.5, then every sensor's particles
+        self.channels = [(signal, name, SENSORS[name][i]) for i, signal in enumerate(SIGNALS) for name in SENSORS]
+        self.reference = self.channels.index(("pm25", reference, SENSORS[reference][0]))
+
+        self.lags = []
+        self.steps = []
+
+        # Streaming state, all grid positions are absolute sample numbers
+        self.resampler = GridResampler([col for _, _, col in self.channels], dt=dt, method=method, max_gap=max_gap)
+        self.buffer = np.zeros((0, len(self.channels)))
+        self.buffer_start = 0       # Grid sample of buffer[0]
+        self.next_window = 0        # Start of the next lag window
+        self.next_scan = 0          # Next sample to test for a step
+
+    def feed(self, chunk):
+        _, samples = self.resampler.feed(chunk)
+        self.buffer = np.concatenate([self.buffer, samples])
+        self._process(final=False)
+
+    def finish(self):
+        self._process(final=True)
+
+    # --- Analysis ---------------------------------------------------------
+
+    def _slice(self, start, end):
+        return self.buffer[start - self.buffer_start:end - self.buffer_start]
+
+    def _process(self, final):
+        buffer_end = self.buffer_start + len(self.buffer)
+
+        while self.next_window + self.window <= buffer_end:
+            self._window_lags(self.next_window)
+            self.next_window += self.step
+
+        if buffer_end > self.next_scan:
+            self._find_steps(buffer_end, final)
+
+        keep_from = min(self.next_window, self.next_scan - self.pre - self.smooth)
+        if keep_from > self.buffer_start:
+            self.buffer = self.buffer[keep_from - self.buffer_start:]
+            self.buffer_start = keep_from
+
+    def _window_lags(self, start):
+        data = self._slice(start, start + self.window)
+        count = np.sum(~np.isnan(data), axis=0)
+        valid = count >= self.min_valid * self.window
+        centered = np.nan_to_num(data - np.nansum(data, axis=0) / np.maximum(count, 1))
+        energy = np.sum(centered ** 2, axis=0)
+
+        n = 1 << int(np.ceil(np.log2(2 * self.window)))
+        spectra = np.fft.rfft(centered, n, axis=0)
+        lags = np.concatenate([np.arange(0, self.max_lag + 1), np.arange(-self.max_lag, 0)])
+
+        for signal in SIGNALS:
+            chans = [i for i, c in enumerate(self.channels) if c[0] == signal]
+            for a, b in combinations(chans, 2):
+                if not (valid[a] and valid[b]) or energy[a] == 0 or energy[b] == 0:
+                    continue
+                cc = np.fft.irfft(np.conj(spectra[:, a]) * spectra[:, b], n)
+                cc = np.concatenate([cc[:self.max_lag + 1], cc[n - self.max_lag:]]) / np.sqrt(energy[a] * energy[b])
+                best = int(np.argmax(cc))
+                self.lags.append({
+                    "window_start_s": round(start * self.dt, 3),
+                    "window_end_s": round((start + self.window) * self.dt, 3),
+                    "signal": signal, "sensor_a": self.channels[a][1], "sensor_b": self.channels[b][1],
+                    "lag_s": round(lags[best] * self.dt, 3), "correlation": round(float(cc[best]), 4),
+                })
+
+    def _find_steps(self, buffer_end, final):
+        # A step needs 'post' samples after it; at the end of the session take what there is
+        scan_end = buffer_end - (0 if final else self.post)
+        first = max(self.next_scan, self.buffer_start + self.smooth)
+        if scan_end - first <= self.smooth:
+            return
+
+        # jump[k]: change of the median level across 'smooth' samples before/after sample first + k
+        ref = self._slice(first - self.smooth, scan_end)[:, self.reference]
+        level = nanmedian(np.lib.stride_tricks.sliding_window_view(ref, self.smooth), axis=1)
+        jump = level[self.smooth:] - level[:-self.smooth]
+
+        i = 0
+        while i < len(jump):
+            if np.isnan(jump[i]) or abs(jump[i]) < self.threshold:
+                i += 1
+                continue
+            # Onset at the strongest jump of this transition
+            j = i
+            while j + 1 < len(jump) and not np.isnan(jump[j + 1]) and abs(jump[j + 1]) >= self.threshold:
+                j += 1
+            if j + 1 == len(jump) and not final:
+                break       # Transition still going on, wait for more data
+            peak = i + int(np.nanargmax(np.abs(jump[i:j + 1])))
+            self._evaluate_step(first + peak, buffer_end)
+            i = peak + self.post
+        self.next_scan = first + i
+
+    def _evaluate_step(self, onset, buffer_end):
+        start = max(onset - self.pre, self.buffer_start)
+        end = min(onset + self.post, buffer_end)
+        data = self._slice(start, end)
+        before = data[:onset - start]
+        after = data[onset - start:]
+        if len(before) == 0 or len(after) < self.settle:
+            return
+
+        baseline = nanmedian(before, axis=0)
+        final = nanmedian(after[-self.settle:], axis=0)
+        for c, (signal, name, _) in enumerate(self.channels):
+            if np.isnan(baseline[c]) or np.isnan(final[c]) or final[c] == baseline[c]:
+                continue
+            progress = (after[:, c] - baseline[c]) / (final[c] - baseline[c])
+            times = {}
+            for level in (10, 50, 90):
+                crossed = np.flatnonzero(progress >= level / 100.0)
+                times[level] = round(crossed[0] * self.dt, 3) if len(crossed) else ""
+            self.steps.append({
+                "onset_s": round(onset * self.dt, 3), "direction": "rise" if final[c] > baseline[c] else "fall",
+                "signal": signal, "sensor": name,
+                "baseline": round(float(baseline[c]), 2), "final": round(float(final[c]), 2),
+                "t10_s": times[10], "t50_s": times[50], "t90_s": times[90],
+            })
+
+def analyze_file(path, **options):
+    analyzer = ResponseAnalyzer(**options)
+    for chunk in iter_chunks(path):
+        if len(chunk["Timestamp_ms"]):
+            analyzer.feed(chunk)
+    analyzer.finish()
+    return analyzer
+
+def write_table(path, fields, rows):
+    with open(path, 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(rows)
+
+def print_summary(analyzer):
+    for signal in SIGNALS:
+        pairs = {}
+        for row in analyzer.lags:
+            if row["signal"] == signal:
+                pairs.setdefault((row["sensor_a"], row["sensor_b"]), []).append(row["lag_s"])
+        for (a, b), lags in pairs.items():
+            print(f"  {signal:9s} {a:>8s} -> {b:<8s} median lag {np.median(lags):+6.1f} s over {len(lags)} windows")
+
+    t90 = {}
+    for row in analyzer.steps:
+        if row["signal"] == "pm25" and row["t90_s"] != "":
+            t90.setdefault(row["sensor"], []).append(row["t90_s"])
+    for name, values in t90.items():
+        print(f"  pm25      {name:>8s} median t90 {np.median(values):6.1f} s over {len(values)} steps")
+
+def main():
+    parser = argparse.ArgumentParser(description='Sensor response-time analysis (lags and t10/t50/t90)')
+    parser.add_argument('files', nargs='+', help='Sessions (.bin, .lz, .csv or .arrow)')
+    parser.add_argument('--dt', type=float, default=1.0, help='Grid spacing [s]')
+    parser.add_argument('--method', choices=METHODS, default="locf", help='Resampling onto the grid')
+    parser.add_argument('--window', type=float, default=600.0, help='Lag window length [s]')
+    parser.add_argument('--step', type=float, default=300.0, help='Lag window step [s]')
+    parser.add_argument('--max-lag', type=float, default=60.0, help='Largest lag searched [s]')
+    parser.add_argument('--reference', default="SPS30", choices=list(SENSORS), help='Sensor used to detect steps')
+    parser.add_argument('--threshold', type=float, default=10.0, help='PM2.5 change that counts as a step [ug/m3]')
+    parser.add_argument('--output-dir', default=OUTPUT_DIR)
+    args = parser.parse_args()
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    for path in args.files:
+        if not os.path.exists(path):
+            print(f"Error: File '{path}' not found.")
+            continue
+        print(f"Analyzing {path}...")
+        analyzer = analyze_file(path, dt=args.dt, method=args.method, window=args.window, step=args.step, max_lag=args.max_lag,
+                                reference=args.reference, threshold=args.threshold)
+        stem = os.path.join(args.output_dir, os.path.splitext(os.path.basename(path))[0])
+        write_table(stem + "_lags.csv", LAG_FIELDS, analyzer.lags)
+        write_table(stem + "_steps.csv", STEP_FIELDS, analyzer.steps)
+        print(f"  {len(analyzer.lags)} window lags, {len(analyzer.steps)} step responses -> {stem}_lags.csv / _steps.csv")
+        print_summary(analyzer)
+
+if __name__ == "__main__":
+    main()
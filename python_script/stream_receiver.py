@@ -0,0 +1,101 @@
+import struct
+import zlib
+import os
+import sys
+import time
+import argparse
+from convert_bin_ascii import PACKET_FORMAT, PACKET_SIZE, HEADER, FOOTER, OUTPUT_DIR
+from sync_logs import open_port
+from extract_memory import get_esp_port
+
+# Every record arrives as 0x00 + COBS(30-byte payload + uint32_t CRC-32) + 0x00
+FRAME_SIZE = PACKET_SIZE + 4
+STATS_INTERVAL = 10     # [s]
+CSV_HEADER = "Counter,Timestamp_ms,SPS30_Particles,SPS30_Conc,PMSA_Particles,PMSA_Conc,PM2012_Particles,PM2012_Conc_GRIMM,PM2012_Conc_TSI,PM2016_Particles,PM2016_Conc\n"
+
+def cobs_decode(block):
+    """Returns the decoded bytes, or None if the block isn't valid COBS."""
+    out = bytearray()
+    i = 0
+    while i < len(block):
+        code = block[i]
+        if code == 0 or i + code > len(block):
+            return None
+        out += block[i + 1 : i + code]
+        i += code
+        if code < 0xFF and i < len(block):
+            out.append(0)
+    return bytes(out)
+
+class StreamStats:
+    def __init__(self):
+        self.records = 0
+        self.crc_errors = 0
+        self.noise = 0          # Debug text or truncated frames between records
+        self.dropped = 0        # Records missing from the counter sequence
+        self.last_counter = None
+
+    def report(self):
+        total = self.records + self.dropped
+        loss = 100.0 * self.dropped / total if total else 0.0
+        print(f"records={self.records} dropped={self.dropped} ({loss:.2f}%) crc_errors={self.crc_errors} noise={self.noise}")
+
+def receive(port, output_filename):
+    ser = open_port(port)
+    ser.timeout = 0.1
+    ser.write(b"stream on\n")
+    print(f"Streaming into {output_filename} (Ctrl+C to stop)...")
+
+    stats = StreamStats()
+    pending = b''
+    next_report = time.time() + STATS_INTERVAL
+    try:
+        with open(output_filename, 'w') as csv_file:
+            csv_file.write(CSV_HEADER)
+            while True:
+                pending += ser.read(max(1, ser.in_waiting))
+                *blocks, pending = pending.split(b'\x00')
+
+                for block in blocks:
+                    if not block:
+                        continue
+                    frame = cobs_decode(block)
+                    if frame is None or len(frame) != FRAME_SIZE:
+                        stats.noise += 1
+                        continue
+                    if zlib.crc32(frame[:PACKET_SIZE]) != struct.unpack('<I', frame[PACKET_SIZE:])[0]:
+                        stats.crc_errors += 1
+                        continue
+
+                    header, count, ts, *values, t1, t2 = struct.unpack(PACKET_FORMAT, frame[:PACKET_SIZE])
+                    if header != HEADER or (t1, t2) != FOOTER:
+                        stats.crc_errors += 1
+                        continue
+                    if stats.last_counter is not None and count > stats.last_counter + 1:
+                        stats.dropped += count - stats.last_counter - 1
+                    stats.last_counter = count
+                    stats.records += 1
+
+                    csv_file.write(",".join(map(str, (count, ts, *values))) + ",\n")
+                    csv_file.flush()
+
+                if time.time() >= next_report:
+                    stats.report()
+                    next_report += STATS_INTERVAL
+    except KeyboardInterrupt:
+        pass
+    finally:
+        ser.write(b"stream off\n")
+        ser.close()
+        print("\nStream stopped.")
+        stats.report()
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Live receiver for the OpenAir USB record stream')
+    parser.add_argument('--port', help='Serial port, asks if several devices are connected')
+    parser.add_argument('--output', help='CSV file to write, default decoded_results/stream_<time>.csv')
+    args = parser.parse_args()
+
+    os.makedirs(OUTPUT_DIR, exist_ok=True)
+    output = args.output or os.path.join(OUTPUT_DIR, time.strftime("stream_%y%m%d-%H%M%S.csv"))
+    receive(args.port or get_esp_port(), output)
@@ -0,0 +1,214 @@
+import serial
+import struct
+import zlib
+import json
+import os
+import sys
+import time
+import argparse
+from extract_memory import get_esp_port
+from lzss import decompress
+
+# --- Configuration ---
+SYNC_DIR = "./synced"                                   # One mirror folder per device
+STATE_FILE = os.path.join(SYNC_DIR, "sync_state.json")  # Sync cursor of every session
+BAUD = 115200           # Ignored by the native USB CDC link, which runs at full USB speed
+TIMEOUT = 3             # [s]
+
+# FRAME_HEADER_FORMAT Breakdown (matches TransferFrameHeader in OpenAirMultiSense.h):
+# <  : Little-endian
+# 2s : char[2] (Magic 'OD')
+# I  : uint32_t (Byte offset of the data in the session)
+# H  : uint16_t (Number of data bytes, 0 = end of session)
+# The data is followed by a uint32_t CRC-32 over header and data.
+# Length ABORT_LENGTH: the device gave up on a frame after repeated NAKs,
+# only the CRC follows.
+# In compressed transfers ('z') the data is an LZSS stream of at most
+# CHUNK_SIZE bytes and 'length' is its compressed size.
+FRAME_HEADER_FORMAT = '<2sIH'
+FRAME_HEADER_SIZE = struct.calcsize(FRAME_HEADER_FORMAT)
+FRAME_MAGIC = b'OD'
+CHUNK_SIZE = 4096
+MAX_FRAME_DATA = CHUNK_SIZE + CHUNK_SIZE // 8 + 1
+RECORD_SIZE = 30        # Delta stride of compressed frames, sizeof(SensorPayload)
+ACK = b'A'
+NAK = b'N'
+ABORT_LENGTH = 0xFFFF
+
+def open_port(port):
+    ser = serial.Serial()
+    ser.port = port
+    ser.baudrate = BAUD
+    ser.timeout = TIMEOUT
+    # Keep DTR/RTS released so opening the port doesn't reset the ESP32-C3
+    ser.dtr = False
+    ser.rts = False
+    ser.open()
+    return ser
+
+def send_command(ser, command):
+    ser.reset_input_buffer()
+    ser.write((command + "\n").encode())
+
+def read_reply(ser, prefix, until=None):
+    """Returns the reply lines starting with 'prefix', skipping debug output, until 'until' (or the first match)."""
+    lines = []
+    deadline = time.time() + TIMEOUT
+    while time.time() < deadline:
+        line = ser.readline().decode(errors='ignore').strip()
+        if until is not None and line == until:
+            return lines
+        if line.startswith(prefix):
+            lines.append(line[len(prefix):].strip())
+            if until is None:
+                return lines
+    return lines
+
+def device_id(ser):
+    send_command(ser, "id")
+    reply = read_reply(ser, "ID ")
+    if not reply:
+        print("❌ Device did not answer. Is the OpenAir firmware running?")
+        sys.exit(1)
+    return reply[0]
+
+def list_sessions(ser):
+    """Returns {name: (size, first_timestamp)} for every file on the device."""
+    send_command(ser, "ls")
+    sessions = {}
+    for line in read_reply(ser, "SESSION ", until="END"):
+        name, size, first_ts = line.split()
+        sessions[name.lstrip('/')] = (int(size), int(first_ts))
+    return sessions
+
+def find_frame_header(ser, expected_offset):
+    """Skips debug text until a plausible frame header for 'expected_offset' is found."""
+    window = b''
+    while True:
+        more = ser.read(FRAME_HEADER_SIZE - len(window))
+        if not more:
+            return None
+        window += more
+        start = window.find(FRAME_MAGIC)
+        if start < 0:
+            window = window[-1:]
+            continue
+        window = window[start:]
+        if len(window) < FRAME_HEADER_SIZE:
+            continue
+        magic, offset, length = struct.unpack(FRAME_HEADER_FORMAT, window)
+        if (length <= MAX_FRAME_DATA or length == ABORT_LENGTH) and offset <= expected_offset:
+            return window, offset, length
+        # 'OD' inside debug text, keep looking right after it
+        window = window[1:]
+
+def fetch(ser, name, cursor, out_file, compress=False):
+    """Appends everything after 'cursor' of a device file to 'out_file'. Returns the new cursor."""
+    send_command(ser, f"get /{name} {cursor}" + (" z" if compress else ""))
+    while True:
+        found = find_frame_header(ser, cursor)
+        if found is None:
+            print(f"  ⚠️  {name}: transfer timed out at byte {cursor}, resuming next time.")
+            return cursor
+        header, offset, length = found
+        if length == ABORT_LENGTH:
+            ser.read(4)
+            print(f"  ⚠️  {name}: device aborted at byte {offset} after repeated errors, resuming next time.")
+            return cursor
+
+        body = ser.read(length + 4)
+        if len(body) < length + 4:
+            print(f"  ⚠️  {name}: short frame at byte {offset}, resuming next time.")
+            return cursor
+        data, crc = body[:length], struct.unpack('<I', body[length:])[0]
+
+        if zlib.crc32(header + data) != crc:
+            ser.write(NAK)
+            continue
+
+        if compress and length > 0:
+            data = decompress(data, stride=RECORD_SIZE)
+
+        # A resent frame we already have is acknowledged but not written twice
+        if offset == cursor:
+            out_file.write(data)
+            out_file.flush()
+            cursor += len(data)
+        ser.write(ACK)
+
+        if length == 0:
+            return cursor
+
+def load_state():
+    if os.path.exists(STATE_FILE):
+        with open(STATE_FILE) as f:
+            return json.load(f)
+    return {}
+
+def save_state(state):
+    with open(STATE_FILE, 'w') as f:
+        json.dump(state, f, indent=2)
+
+def archive_local(path, first_ts):
+    """A reused session name on the device: keep the old copy as its own session."""
+    if os.path.exists(path):
+        base, ext = os.path.splitext(path)
+        os.replace(path, f"{base}_{first_ts}{ext}")
+
+def sync_device(port=None, compress=True):
+    """
+    Pulls only the bytes each device session gained since the last sync
+    into SYNC_DIR/<device id>/. Returns that folder.
+    With 'compress' the device LZSS-compresses every frame on the fly.
+    """
+    ser = open_port(port or get_esp_port())
+    dev = device_id(ser)
+    device_dir = os.path.join(SYNC_DIR, dev)
+    os.makedirs(device_dir, exist_ok=True)
+
+    state = load_state()
+    cursors = state.setdefault(dev, {})
+    sessions = list_sessions(ser)
+    print(f"✅ Device {dev}: {len(sessions)} files on flash")
+
+    transferred = 0
+    start = time.time()
+    # Sessions first, so their index files can follow the same reset decision
+    for name in sorted(sessions, key=lambda n: n.endswith(".idx")):
+        size, first_ts = sessions[name]
+        path = os.path.join(device_dir, name)
+        session = os.path.splitext(name)[0] + ".bin"
+        if name.endswith(".idx") and session in sessions:
+            first_ts = sessions[session][1]
+        known = cursors.get(name, {"cursor": 0, "first_ts": first_ts})
+
+        if known["first_ts"] != first_ts or size < known["cursor"]:
+            print(f"  {name}: new session under a reused name, starting over.")
+            archive_local(path, known["first_ts"])
+            known = {"cursor": 0, "first_ts": first_ts}
+
+        # The local copy is only ever appended with verified data
+        local_size = os.path.getsize(path) if os.path.exists(path) else 0
+        known["cursor"] = cursor = min(known["cursor"], local_size)
+        if size > cursor:
+            with open(path, 'ab') as out_file:
+                # Drop anything written after the last saved cursor
+                out_file.truncate(cursor)
+                cursor = fetch(ser, name, cursor, out_file, compress and not name.endswith(".lz"))
+            transferred += cursor - known["cursor"]
+            print(f"  {name}: {known['cursor']} -> {cursor} bytes")
+
+        cursors[name] = {"cursor": cursor, "first_ts": first_ts}
+        save_state(state)
+
+    ser.close()
+    elapsed = max(time.time() - start, 1e-6)
+    print(f"Transferred {transferred} new bytes in {elapsed:.1f}s ({transferred / elapsed / 1024:.0f} kB/s)")
+    return device_dir
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Incremental log download over USB')
+    parser.add_argument('port', nargs='?', help='Serial port, asks if several devices are connected')
+    parser.add_argument('--raw', action='store_true', help='Transfer uncompressed frames')
+    args = parser.parse_args()
+    sync_device(args.port, compress=not args.raw)
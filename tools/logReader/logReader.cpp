@@ -0,0 +1,141 @@
+#include "logReader.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOG_READER_X86
+#endif
+
+const char* CSV_HEADER = "Counter,Timestamp_ms,SPS30_Particles,SPS30_Conc,PMSA_Particles,PMSA_Conc,"
+                         "PM2012_Particles,PM2012_Conc_GRIMM,PM2012_Conc_TSI,PM2016_Particles,PM2016_Conc\n";
+
+LogImage::~LogImage() {
+    close();
+}
+
+bool LogImage::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        _error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        _error = path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    _size = st.st_size;
+    if (_size > 0) {
+        void* map = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            _error = path + ": " + strerror(errno);
+            _size = 0;
+            ::close(fd);
+            return false;
+        }
+        madvise(map, _size, MADV_SEQUENTIAL);
+        _data = static_cast<const uint8_t*>(map);
+    }
+    ::close(fd);    // The mapping stays valid
+    return true;
+}
+
+void LogImage::close() {
+    if (_data) munmap(const_cast<uint8_t*>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+}
+
+static size_t findHeaderScalar(const uint8_t* data, size_t size, size_t from) {
+    if (size < 2) return size;
+    for (size_t i = from; i + 1 < size; i++) {
+        const uint8_t* hit = static_cast<const uint8_t*>(memchr(data + i, RECORD_HEADER[0], size - 1 - i));
+        if (!hit) break;
+        i = hit - data;
+        if (data[i + 1] == RECORD_HEADER[1]) return i;
+    }
+    return size;
+}
+
+#ifdef LOG_READER_X86
+static size_t findHeaderSse2(const uint8_t* data, size_t size, size_t from) {
+    const __m128i first = _mm_set1_epi8((char)RECORD_HEADER[0]);
+    const __m128i second = _mm_set1_epi8((char)RECORD_HEADER[1]);
+    size_t i = from;
+
+    // Compare 16 positions at once: byte i against 'O' and byte i+1 against 'A'
+    for (; i + 17 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, second)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return findHeaderScalar(data, size, i);
+}
+
+__attribute__((target("avx2")))
+static size_t findHeaderAvx2(const uint8_t* data, size_t size, size_t from) {
+    const __m256i first = _mm256_set1_epi8((char)RECORD_HEADER[0]);
+    const __m256i second = _mm256_set1_epi8((char)RECORD_HEADER[1]);
+    size_t i = from;
+
+    for (; i + 33 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, second)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return findHeaderSse2(data, size, i);
+}
+
+static bool hasAvx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+size_t findRecordHeader(const uint8_t* data, size_t size, size_t from) {
+#ifdef LOG_READER_X86
+    return hasAvx2() ? findHeaderAvx2(data, size, from) : findHeaderSse2(data, size, from);
+#else
+    return findHeaderScalar(data, size, from);
+#endif
+}
+
+const char* headerSearchName() {
+#ifdef LOG_READER_X86
+    return hasAvx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+size_t nextRecord(const uint8_t* data, size_t size, size_t from) {
+    // Fast path: records are normally written back to back
+    if (isValidRecord(data, size, from)) return from;
+
+    // Resynchronize: any 'OA' may start a record, the terminator decides
+    for (size_t i = findRecordHeader(data, size, from); i < size; i = findRecordHeader(data, size, i + 1)) {
+        if (isValidRecord(data, size, i)) return i;
+    }
+    return size;
+}
+
+int formatCsvRow(const SensorPayload& r, char* buf, size_t len) {
+    return snprintf(buf, len, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,\n",
+                    r.counter, r.timestamp,
+                    r.sps30Data.particles, r.sps30Data.concentration,
+                    r.pmsa003iData.particles, r.pmsa003iData.concentration,
+                    r.cubicPm2012.particles, r.cubicPm2012.concentration, r.cubicPm2012Tsi,
+                    r.cubicPm2016.particles, r.cubicPm2016.concentration);
+}
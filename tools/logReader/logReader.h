@@ -0,0 +1,102 @@
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iterator>
+#include <string>
+#include "OpenAirMultiSense.h"
+
+// Host-side reader for OpenAir logs: a session file ("pmLogsN.bin") or a
+// raw LittleFS partition image. The file is memory-mapped and records are
+// handed out as pointers into the mapping, nothing is copied.
+//
+// A record is valid when it starts with the 'OA' header and ends with the
+// 0xAA 0xBB terminator. After a valid record the next one is expected right
+// behind it; only when that fails is the rest of the image searched for the
+// next header, 16/32 bytes at a time with SSE2/AVX2 where available.
+
+static const uint8_t RECORD_HEADER[2] = {0x4f, 0x41};
+static const uint8_t RECORD_TERMINATOR[2] = {0xaa, 0xbb};
+
+class LogImage {
+public:
+    LogImage() {}
+    ~LogImage();
+    LogImage(const LogImage&) = delete;
+    LogImage& operator=(const LogImage&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    const uint8_t* data() const {return _data;}
+    size_t size() const {return _size;}
+    const std::string& error() const {return _error;}
+
+private:
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+    std::string _error;
+};
+
+// Offset of the next 'OA' header at or after 'from', or 'size' if there is none
+size_t findRecordHeader(const uint8_t* data, size_t size, size_t from);
+
+// Name of the header search used on this CPU ("avx2", "sse2" or "scalar")
+const char* headerSearchName();
+
+inline bool isValidRecord(const uint8_t* data, size_t size, size_t offset) {
+    return offset + sizeof(SensorPayload) <= size &&
+           data[offset] == RECORD_HEADER[0] && data[offset + 1] == RECORD_HEADER[1] &&
+           data[offset + sizeof(SensorPayload) - 2] == RECORD_TERMINATOR[0] &&
+           data[offset + sizeof(SensorPayload) - 1] == RECORD_TERMINATOR[1];
+}
+
+// Offset of the next valid record at or after 'from', or 'size'
+size_t nextRecord(const uint8_t* data, size_t size, size_t from);
+
+// Forward iterator over the valid records of a byte range
+class RecordIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = SensorPayload;
+    using difference_type = ptrdiff_t;
+    using pointer = const SensorPayload*;
+    using reference = const SensorPayload&;
+
+    RecordIterator(const uint8_t* data, size_t size, size_t offset)
+        : _data(data), _size(size), _offset(nextRecord(data, size, offset)) {}
+
+    reference operator*() const {return *reinterpret_cast<pointer>(_data + _offset);}
+    pointer operator->() const {return reinterpret_cast<pointer>(_data + _offset);}
+    size_t offset() const {return _offset;}
+
+    RecordIterator& operator++() {
+        _offset = nextRecord(_data, _size, _offset + sizeof(SensorPayload));
+        return *this;
+    }
+    bool operator==(const RecordIterator& other) const {return _offset == other._offset;}
+    bool operator!=(const RecordIterator& other) const {return _offset != other._offset;}
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _offset;
+};
+
+// The records of a byte range, for range-based for loops
+class RecordRange {
+public:
+    RecordRange(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+    RecordIterator begin() const {return RecordIterator(_data, _size, 0);}
+    RecordIterator end() const {return RecordIterator(_data, _size, _size);}
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+};
+
+// Same columns as python_script/convert_bin_ascii.py
+extern const char* CSV_HEADER;
+int formatCsvRow(const SensorPayload& record, char* buf, size_t len);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "logReader.h"
+#include "parallelDecoder.h"
+
+// oalog - decode OpenAir logs (session files or raw partition images)
+//   oalog <image>... [--csv out.csv] [--bin out.bin] [--csv-dir DIR]
+//                    [--merge] [--jobs N] [--chunk BYTES]
+// --csv writes the same columns as convert_bin_ascii.py, --bin writes the
+// valid records back to back (a clean session file). --csv-dir writes one
+// <name>.csv per input instead. --merge orders the records of all inputs
+// by counter and drops duplicates.
+
+static void usage() {
+    fprintf(stderr, "Usage: oalog <image>... [--csv out.csv] [--bin out.bin] [--csv-dir DIR] [--merge] [--jobs N] [--chunk BYTES]\n");
+}
+
+// Formats 'records' as CSV rows on the thread pool, keeping their order
+static bool writeCsv(const std::string& path, const std::vector<const SensorPayload*>& records, unsigned threads) {
+    FILE* csv = fopen(path.c_str(), "w");
+    if (!csv) return false;
+    fputs(CSV_HEADER, csv);
+
+    const size_t sliceRecords = 1 << 16;
+    size_t slices = (records.size() + sliceRecords - 1) / sliceRecords;
+    std::vector<std::string> text(slices);
+    runParallel(slices, threads, [&](size_t s) {
+        char row[128];
+        size_t end = std::min(records.size(), (s + 1) * sliceRecords);
+        text[s].reserve((end - s * sliceRecords) * 48);
+        for (size_t i = s * sliceRecords; i < end; i++) {
+            text[s].append(row, formatCsvRow(*records[i], row, sizeof(row)));
+        }
+    });
+    for (const std::string& t : text) fwrite(t.data(), 1, t.size(), csv);
+    fclose(csv);
+    return true;
+}
+
+static std::string stem(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> inputs;
+    std::string csvPath, binPath, csvDir;
+    bool merge = false;
+    DecodeOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc) {
+            binPath = argv[++i];
+        } else if (strcmp(argv[i], "--csv-dir") == 0 && i + 1 < argc) {
+            csvDir = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            options.chunkSize = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--merge") == 0) {
+            merge = true;
+        } else if (argv[i][0] != '-') {
+            inputs.push_back(argv[i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (inputs.empty()) {
+        usage();
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<LogImage>> images;
+    std::vector<DecodeInput> ranges;
+    size_t totalBytes = 0;
+    for (const std::string& path : inputs) {
+        images.emplace_back(new LogImage());
+        if (!images.back()->open(path)) {
+            fprintf(stderr, "Error: %s\n", images.back()->error().c_str());
+            return 1;
+        }
+        ranges.push_back({images.back()->data(), images.back()->size()});
+        totalBytes += images.back()->size();
+    }
+
+    std::vector<std::vector<const SensorPayload*>> decoded = decodeParallel(ranges, options);
+
+    std::vector<const SensorPayload*> records;
+    if (merge) {
+        records = mergeByCounter(decoded);
+    } else {
+        for (const auto& r : decoded) records.insert(records.end(), r.begin(), r.end());
+    }
+
+    if (!csvDir.empty()) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            std::string path = csvDir + "/" + stem(inputs[i]) + ".csv";
+            if (!writeCsv(path, decoded[i], options.threads)) {
+                fprintf(stderr, "Error: could not write %s\n", path.c_str());
+                return 1;
+            }
+            printf("%s: %zu valid records -> %s\n", inputs[i].c_str(), decoded[i].size(), path.c_str());
+        }
+    }
+    if (!csvPath.empty() && !writeCsv(csvPath, records, options.threads)) {
+        fprintf(stderr, "Error: could not write %s\n", csvPath.c_str());
+        return 1;
+    }
+    if (!binPath.empty()) {
+        FILE* bin = fopen(binPath.c_str(), "wb");
+        if (!bin) {
+            fprintf(stderr, "Error: could not write %s\n", binPath.c_str());
+            return 1;
+        }
+        for (const SensorPayload* record : records) fwrite(record, sizeof(SensorPayload), 1, bin);
+        fclose(bin);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu input(s): %zu valid records in %zu bytes, %.2f ms (%s header search)\n",
+           inputs.size(), records.size(), totalBytes, ms, headerSearchName());
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "parallelDecoder.h"
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+void runParallel(size_t count, unsigned threads, const std::function<void(size_t)>& job) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, count);
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) job(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (std::thread& t : pool) t.join();
+}
+
+struct Chunk {
+    size_t input;
+    size_t start;
+    size_t end;
+    std::vector<size_t> offsets;    // Records starting in [start, end)
+};
+
+std::vector<std::vector<const SensorPayload*>> decodeParallel(const std::vector<DecodeInput>& inputs,
+                                                              const DecodeOptions& options) {
+    size_t chunkSize = std::max(options.chunkSize, sizeof(SensorPayload));
+
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        for (size_t start = 0; start < inputs[i].size; start += chunkSize) {
+            chunks.push_back({i, start, std::min(start + chunkSize, inputs[i].size), {}});
+        }
+    }
+
+    runParallel(chunks.size(), options.threads, [&](size_t c) {
+        Chunk& chunk = chunks[c];
+        const DecodeInput& in = inputs[chunk.input];
+        chunk.offsets.reserve((chunk.end - chunk.start) / sizeof(SensorPayload) + 1);
+        for (size_t off = nextRecord(in.data, in.size, chunk.start); off < chunk.end;
+             off = nextRecord(in.data, in.size, off + sizeof(SensorPayload))) {
+            chunk.offsets.push_back(off);
+        }
+    });
+
+    // Stitch chunk boundaries in order (see header)
+    std::vector<std::vector<const SensorPayload*>> decoded(inputs.size());
+    size_t resumeAt = 0;        // Where a single-threaded scan would continue
+    for (size_t c = 0; c < chunks.size(); c++) {
+        Chunk& chunk = chunks[c];
+        const DecodeInput& in = inputs[chunk.input];
+        std::vector<const SensorPayload*>& out = decoded[chunk.input];
+        if (chunk.start == 0) resumeAt = 0;
+
+        auto found = std::lower_bound(chunk.offsets.begin(), chunk.offsets.end(), resumeAt);
+        size_t off = nextRecord(in.data, in.size, resumeAt);
+        while (off < chunk.end && (found == chunk.offsets.end() || off != *found)) {
+            // Only reached when the chunk's own scan was misled by bytes inside a record
+            out.push_back(reinterpret_cast<const SensorPayload*>(in.data + off));
+            resumeAt = off + sizeof(SensorPayload);
+            found = std::lower_bound(found, chunk.offsets.end(), resumeAt);
+            off = nextRecord(in.data, in.size, resumeAt);
+        }
+        for (; found != chunk.offsets.end(); ++found) {
+            out.push_back(reinterpret_cast<const SensorPayload*>(in.data + *found));
+            resumeAt = *found + sizeof(SensorPayload);
+        }
+    }
+    return decoded;
+}
+
+std::vector<const SensorPayload*> mergeByCounter(const std::vector<std::vector<const SensorPayload*>>& decoded) {
+    std::vector<const SensorPayload*> merged;
+    for (const auto& records : decoded) merged.insert(merged.end(), records.begin(), records.end());
+
+    std::stable_sort(merged.begin(), merged.end(), [](const SensorPayload* a, const SensorPayload* b) {
+        if (a->counter != b->counter) return a->counter < b->counter;
+        return a->timestamp < b->timestamp;
+    });
+    merged.erase(std::unique(merged.begin(), merged.end(), [](const SensorPayload* a, const SensorPayload* b) {
+        return memcmp(a, b, sizeof(SensorPayload)) == 0;
+    }), merged.end());
+    return merged;
+}
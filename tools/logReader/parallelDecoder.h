@@ -0,0 +1,42 @@
+#ifndef PARALLEL_DECODER_H
+#define PARALLEL_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "logReader.h"
+
+// Decodes large images, or many session files at once, on a thread pool.
+//
+// Every input is cut into chunks. A chunk owns the records that start
+// inside it and scans from its first byte, resynchronizing on the next
+// valid header like a damaged region. Chunk boundaries are then stitched
+// in order: records that start inside the previous chunk's last record
+// are dropped, and the scan is repeated from that record's end until it
+// meets a record the chunk already found. The result is identical to a
+// single-threaded scan of the whole input.
+
+struct DecodeInput {
+    const uint8_t* data;
+    size_t size;
+};
+
+struct DecodeOptions {
+    unsigned threads = 0;               // 0 = one per core
+    size_t chunkSize = 4 << 20;         // [bytes]
+};
+
+// Records of every input, in input order and file order
+std::vector<std::vector<const SensorPayload*>> decodeParallel(const std::vector<DecodeInput>& inputs,
+                                                              const DecodeOptions& options = DecodeOptions());
+
+// Merges the records of all inputs in (counter, timestamp) order and drops
+// byte-identical duplicates, e.g. stale copies of blocks in a partition image
+std::vector<const SensorPayload*> mergeByCounter(const std::vector<std::vector<const SensorPayload*>>& decoded);
+
+// Runs job(0) .. job(count - 1) on 'threads' workers
+void runParallel(size_t count, unsigned threads, const std::function<void(size_t)>& job);
+
+#endif